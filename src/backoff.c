@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "backoff.h"
+#include "coro.h"
+
+static const char *names[BACKOFF_KINDS] = { "nanosleep", "pause", "exp", "yield", "random" };
+
+static const int PAUSE_SPINS = 64;              // pause instructions per wait
+static const long EXP_MIN_NS = 1000;            // first exponential delay
+static const long EXP_MAX_NS = 1000000;         // cap on exponential delays
+static const unsigned EXP_MAX_ATTEMPT = 10;     // EXP_MIN_NS << 10 > EXP_MAX_NS
+
+static inline void
+cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static void
+sleep_ns(long ns)
+{
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+    nanosleep(&ts, NULL);
+}
+
+// name of a policy
+const char *
+backoff_kind_name(enum backoff_kind kind)
+{
+    return names[kind];
+}
+
+// look up a policy by name
+bool
+backoff_kind_parse(const char *name, enum backoff_kind *kind)
+{
+    for (int i = 0; i < BACKOFF_KINDS; i++) {
+        if (!strcmp(name, names[i])) {
+            *kind = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+backoff_init(struct backoff *b, enum backoff_kind kind, uint64_t seed)
+{
+    b->kind = kind;
+    b->attempt = 0;
+    rng_seed(&b->rng, seed);
+}
+
+void
+backoff_wait(struct backoff *b)
+{
+    // a coroutine must not put its thread to sleep: the other players
+    // of its game run on that thread
+    if (coro_current()) {
+        coro_yield();
+        return;
+    }
+
+    long delay = EXP_MIN_NS << b->attempt;
+    if (delay > EXP_MAX_NS)
+        delay = EXP_MAX_NS;
+
+    switch (b->kind) {
+    case BACKOFF_NANOSLEEP:
+        sleep_ns(1);
+        break;
+    case BACKOFF_PAUSE:
+        for (int i = 0; i < PAUSE_SPINS; i++)
+            cpu_relax();
+        break;
+    case BACKOFF_EXP:
+        sleep_ns(delay);
+        break;
+    case BACKOFF_YIELD:
+        sched_yield();
+        break;
+    default:
+        sleep_ns(rng_below(&b->rng, delay) + 1);
+    }
+    if (b->attempt < EXP_MAX_ATTEMPT)
+        b->attempt++;
+}
+
+void
+backoff_reset(struct backoff *b)
+{
+    b->attempt = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __BACKOFF_H
+#define __BACKOFF_H
+/*
+ * What a player does between attempts to get at the dutch piles.
+ *
+ * Each player keeps a struct backoff. backoff_wait() waits according
+ * to the policy and counts the attempt; backoff_reset() starts over
+ * after the player got something done. Only the exponential and
+ * randomized policies wait longer the more attempts failed in a row.
+ * Coroutines (coro.h) yield to the next coroutine whatever the policy.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rng.h"
+
+enum backoff_kind {
+    BACKOFF_NANOSLEEP,  // nanosleep for 1ns, i.e. a syscall and a timer slack
+    BACKOFF_PAUSE,      // spin on the CPU's pause instruction
+    BACKOFF_EXP,        // nanosleep, doubling from 1us up to 1ms
+    BACKOFF_YIELD,      // sched_yield
+    BACKOFF_RANDOM,     // nanosleep for a random time up to the EXP delay
+    BACKOFF_KINDS
+};
+
+struct backoff {
+    enum backoff_kind kind;
+    unsigned attempt;           // attempts since the last reset
+    struct rng rng;             // BACKOFF_RANDOM
+};
+
+// name of a policy, as accepted by backoff_kind_parse()
+const char *backoff_kind_name(enum backoff_kind kind);
+
+// look up a policy by name; returns false if there is none
+bool backoff_kind_parse(const char *name, enum backoff_kind *kind);
+
+// `seed` only matters for BACKOFF_RANDOM
+void backoff_init(struct backoff *b, enum backoff_kind kind, uint64_t seed);
+void backoff_wait(struct backoff *b);
+void backoff_reset(struct backoff *b);
+#endif /* backoff.h */
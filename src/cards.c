@@ -0,0 +1,28 @@
+/*
+ * Card relations, see cards.h
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cards.h"
+
+uint64_t card_post_fits[256];
+uint64_t card_dutch_fits[256];
+
+// fill in the relations before main() runs, so that they are there
+// for every use of the game rules
+static void __attribute__((constructor))
+cards_init(void)
+{
+    for (int card = 0; card < 256; card++) {
+        for (int face = 0; face <= CARD_FACE; face++) {
+            enum Color front = get_front_color(card), topfront = get_front_color(face);
+            int number = get_card_number(card), topnumber = get_card_number(face);
+            if (topnumber == number + 1 && opposite_colors(front, topfront))
+                card_post_fits[card] |= 1ull << face;
+            if (number == topnumber + 1 && front == topfront)
+                card_dutch_fits[card] |= 1ull << face;
+        }
+    }
+}
@@ -10,6 +10,38 @@
 enum Color { RED, GREEN, BLUE, YELLOW };
 static const char *colors[] = { "R", "G", "B", "Y" };
 
+/*
+ * Which card may go on which is fixed, and depends only on the front
+ * color and number of the two cards: their face, card & CARD_FACE.
+ * For every card, cards.c computes at startup the faces of the cards
+ * it may go on, as a bit mask indexed by face.
+ */
+#define CARD_FACE 0x3f
+
+// bit `face` is set if the card may go on top of a post pile card with
+// that face: one number lower and of the opposite gender
+extern uint64_t card_post_fits[256];
+// bit `face` is set if the card may follow a dutch pile card with that
+// face: one number higher and of the same front color
+extern uint64_t card_dutch_fits[256];
+
+static bool fits_on_post(uint8_t card, uint8_t top) __attribute__((__unused__));
+static bool follows_on_dutch(uint8_t card, uint8_t top) __attribute__((__unused__));
+
+// may `card` go on a post pile whose top card is `top`
+static bool
+fits_on_post(uint8_t card, uint8_t top)
+{
+    return card_post_fits[card] >> (top & CARD_FACE) & 1;
+}
+
+// may `card` go on a dutch pile whose top card is `top`
+static bool
+follows_on_dutch(uint8_t card, uint8_t top)
+{
+    return card_dutch_fits[card] >> (top & CARD_FACE) & 1;
+}
+
 static enum Color 
 get_back_color(uint8_t card)
 {
@@ -30,6 +62,7 @@ get_card_number(uint8_t card)
 
 static uint8_t make_card(enum Color back, enum Color front, int number) __attribute__((__unused__));
 static bool opposite_colors(enum Color c1, enum Color c2) __attribute__((__unused__));
+static void print_card(uint8_t card, bool includeback, FILE *file) __attribute__((__unused__));
 static bool 
 opposite_colors(enum Color c1, enum Color c2)
 {
@@ -0,0 +1,55 @@
+/*
+ * Flat combining, see combine.h
+ */
+#include <string.h>
+
+#include "combine.h"
+#include "coro.h"
+
+void
+combiner_init(struct combiner *c)
+{
+    memset(c, 0, sizeof *c);
+}
+
+// run every posted operation; called by the combiner holding `lock`
+static void
+combine_pass(struct combiner *c)
+{
+    for (int i = 0; i < COMBINE_SLOTS; i++) {
+        struct combine_slot *s = &c->slots[i];
+        if (__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE)) {
+            s->result = s->fn(s->arg);
+            c->ops++;
+            __atomic_store_n(&s->pending, false, __ATOMIC_RELEASE);
+        }
+    }
+    c->passes++;
+}
+
+// run fn(arg) while holding `lock`, through slot `slot`
+int
+combine(struct combiner *c, struct game_lock *lock, int slot,
+        int (*fn)(void *arg), void *arg)
+{
+    struct combine_slot *s = &c->slots[slot];
+    s->fn = fn;
+    s->arg = arg;
+    __atomic_store_n(&s->pending, true, __ATOMIC_RELEASE);
+
+    for (;;) {
+        if (!__atomic_load_n(&s->pending, __ATOMIC_ACQUIRE))
+            return s->result;
+        if (!__atomic_load_n(&c->busy, __ATOMIC_RELAXED)
+            && !__atomic_exchange_n(&c->busy, true, __ATOMIC_ACQUIRE)) {
+            // posted before the pass starts, so it runs in this pass
+            game_lock(lock);
+            combine_pass(c);
+            game_unlock(lock);
+            __atomic_store_n(&c->busy, false, __ATOMIC_RELEASE);
+            return s->result;
+        }
+        // let the combiner run, or the next coroutine
+        coro_yield();
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __COMBINE_H
+#define __COMBINE_H
+/*
+ * Flat combining: instead of each thread taking a lock to run its own
+ * short critical section, threads post their operation in a slot of
+ * their own, and whichever thread becomes the combiner takes the lock
+ * once and runs every posted operation in one pass. The others wait on
+ * their slot, which only the combiner writes to, and find their result
+ * there. Under contention, the lock and the data it protects stay in
+ * the combiner's cache instead of moving to every thread in turn.
+ */
+#include <stdbool.h>
+
+#include "gamelock.h"
+
+#define COMBINE_SLOTS 4
+
+// a thread's slot; each on a cache line of its own
+struct combine_slot {
+    int (*fn)(void *arg);       // operation to run
+    void *arg;
+    int result;                 // what fn returned, once done
+    bool pending;               // posted and not yet run, accessed atomically
+} __attribute__((aligned(64)));
+
+struct combiner {
+    bool busy __attribute__((aligned(64)));     // a thread is combining,
+                                                // accessed atomically
+    long passes;                // combining passes, written by the combiner
+    long ops;                   // operations run in them
+    struct combine_slot slots[COMBINE_SLOTS];
+};
+
+void combiner_init(struct combiner *c);
+
+// run fn(arg) while holding `lock`, through slot `slot`, which only the
+// calling thread may use. Returns what fn returned.
+int combine(struct combiner *c, struct game_lock *lock, int slot,
+            int (*fn)(void *arg), void *arg);
+#endif /* combine.h */
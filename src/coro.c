@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <sched.h>
+
+#include "coro.h"
+
+// scheduler running on this thread, if any
+static __thread struct coro_sched *self;
+
+// first function on a coroutine's stack. When it returns, uc_link
+// switches back to the scheduler.
+static void
+coro_trampoline(void)
+{
+    struct coro *c = self->current;
+    c->fn(c->arg);
+    c->done = true;
+}
+
+void
+coro_sched_init(struct coro_sched *sched)
+{
+    list_init(&sched->ready);
+    sched->current = NULL;
+    sched->switches = 0;
+}
+
+// create a coroutine that will run fn(arg) on `sched`
+struct coro *
+coro_spawn(struct coro_sched *sched, void (*fn)(void *), void *arg)
+{
+    struct coro *c = malloc(sizeof *c);
+    c->fn = fn;
+    c->arg = arg;
+    c->done = false;
+    c->stack = malloc(CORO_STACK_SIZE);
+
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = c->stack;
+    c->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+    c->ctx.uc_link = &sched->ctx;
+    makecontext(&c->ctx, coro_trampoline, 0);
+    list_push_back(&sched->ready, &c->elem);
+    return c;
+}
+
+// run coroutines on the calling thread until none is left
+void
+coro_sched_run(struct coro_sched *sched)
+{
+    self = sched;
+    while (!list_empty(&sched->ready)) {
+        struct coro *c = list_entry(list_pop_front(&sched->ready), struct coro, elem);
+        sched->current = c;
+        swapcontext(&sched->ctx, &c->ctx);
+        sched->current = NULL;
+        sched->switches++;
+        if (c->done) {
+            free(c->stack);
+            free(c);
+        }
+    }
+    self = NULL;
+}
+
+// the running coroutine, or NULL
+struct coro *
+coro_current(void)
+{
+    return self ? self->current : NULL;
+}
+
+// let the next coroutine run
+void
+coro_yield(void)
+{
+    struct coro *c = coro_current();
+    if (c == NULL) {
+        sched_yield();
+        return;
+    }
+    list_push_back(&self->ready, &c->elem);
+    swapcontext(&c->ctx, &self->ctx);
+}
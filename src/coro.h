@@ -0,0 +1,51 @@
+#ifndef __CORO_H
+#define __CORO_H
+/*
+ * Cooperative user-space threads (coroutines) built on ucontext.
+ *
+ * A struct coro_sched runs coroutines on the calling OS thread, round
+ * robin: each runs until it yields or returns. Switching between
+ * coroutines saves and restores registers in user space instead of
+ * going through the kernel scheduler.
+ *
+ * Coroutines never run in parallel with others of the same scheduler,
+ * and a coroutine is only ever switched out in coro_yield().
+ */
+#include <ucontext.h>
+#include <stdbool.h>
+
+#include "list.h"
+
+struct coro {
+    ucontext_t ctx;
+    struct list_elem elem;      // in the scheduler's ready queue
+    void (*fn)(void *arg);
+    void *arg;
+    bool done;                  // fn has returned
+    void *stack;
+};
+
+struct coro_sched {
+    ucontext_t ctx;             // where coroutines switch back to
+    struct list ready;          // runnable coroutines, in run order
+    struct coro *current;       // running coroutine, or NULL
+    long switches;              // coroutine switches so far
+};
+
+// bytes of stack per coroutine
+#define CORO_STACK_SIZE (64 * 1024)
+
+void coro_sched_init(struct coro_sched *sched);
+
+// create a coroutine that will run fn(arg) on `sched`
+struct coro *coro_spawn(struct coro_sched *sched, void (*fn)(void *), void *arg);
+
+// run coroutines on the calling thread until none is left
+void coro_sched_run(struct coro_sched *sched);
+
+// the running coroutine, or NULL if the caller is not a coroutine
+struct coro *coro_current(void);
+
+// let the next coroutine run; outside a coroutine, yield the CPU
+void coro_yield(void);
+#endif /* coro.h */
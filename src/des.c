@@ -0,0 +1,128 @@
+/*
+ * Discrete-event simulation of a game, see des.h
+ */
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "des.h"
+
+static const char *names[DES_DISTS] = { "exp", "uniform", "fixed" };
+
+// name of a distribution
+const char *
+des_dist_name(enum des_dist dist)
+{
+    return names[dist];
+}
+
+// look up a distribution by name
+bool
+des_dist_parse(const char *name, enum des_dist *dist)
+{
+    for (int i = 0; i < DES_DISTS; i++) {
+        if (!strcmp(name, names[i])) {
+            *dist = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// uniformly distributed in [0, 1)
+static double
+rng_unit(struct rng *rng)
+{
+    return (rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+// draw a think time for `seat`
+double
+des_think(const struct des_model *model, int seat, struct rng *rng)
+{
+    double mean = model->mean[seat];
+    switch (model->dist) {
+    case DES_EXP:
+        return -mean * log(1 - rng_unit(rng));
+    case DES_UNIFORM:
+        return 2 * mean * rng_unit(rng);
+    default:
+        return mean;
+    }
+}
+
+static bool
+event_before(const struct des_event *a, const struct des_event *b)
+{
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void
+des_push(struct des_queue *q, double time, int seat)
+{
+    int i = q->n++;
+    struct des_event e = { time, q->seq++, seat };
+    while (i > 0 && event_before(&e, &q->heap[(i - 1) / 2])) {
+        q->heap[i] = q->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    q->heap[i] = e;
+}
+
+static struct des_event
+des_pop(struct des_queue *q)
+{
+    struct des_event top = q->heap[0];
+    struct des_event last = q->heap[--q->n];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= q->n)
+            break;
+        if (child + 1 < q->n && event_before(&q->heap[child + 1], &q->heap[child]))
+            child++;
+        if (!event_before(&q->heap[child], &last))
+            break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return top;
+}
+
+// play `g` with think times drawn from `model`
+void
+game_play_des(struct game *g, const struct des_model *model, uint64_t seed,
+              struct des_stats *stats, FILE *out)
+{
+    struct rng rng;
+    rng_seed(&rng, seed);
+    struct des_queue q = { .n = 0 };
+    bool waiting[4] = { false };    // stuck until the dutch piles change
+
+    for (int seat = 0; seat < 4; seat++)
+        des_push(&q, des_think(model, seat, &rng), seat);
+
+    double now = 0;
+    stats->events = 0;
+    while (q.n > 0 && !game_over(g)) {
+        struct des_event e = des_pop(&q);
+        now = e.time;
+        stats->events++;
+        struct player_state *player = &g->state.players[e.seat];
+        if (!player_try_to_make_one_move(g, player, out)) {
+            waiting[e.seat] = true;
+            player_mark_deadlocked(g, player);
+            continue;
+        }
+        // every move changes the dutch piles, so the others look again
+        for (int seat = 0; seat < 4; seat++) {
+            if (waiting[seat]) {
+                waiting[seat] = false;
+                des_push(&q, now + des_think(model, seat, &rng), seat);
+            }
+        }
+        des_push(&q, now + des_think(model, e.seat, &rng), e.seat);
+    }
+    stats->time = now;
+}
@@ -0,0 +1,68 @@
+#ifndef __DES_H
+#define __DES_H
+/*
+ * Discrete-event simulation of a game (MODE=des).
+ *
+ * Instead of threads racing for the dutch piles, each player thinks
+ * for a time drawn from their own distribution, then makes a move with
+ * player_try_to_make_one_move(). Moves happen in order of virtual time,
+ * kept in a priority queue of events; nothing sleeps, so games run as
+ * fast as the moves can be computed. A player who cannot move waits
+ * until the dutch piles change, and the game ends when someone blitzes
+ * or nobody is left waiting for a turn. Given the deal and a seed for
+ * the think times, a game always plays out the same way.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+#include "rng.h"
+
+// how think times are distributed around their mean
+enum des_dist {
+    DES_EXP,            // exponential
+    DES_UNIFORM,        // uniform in [0, 2 * mean]
+    DES_FIXED,          // always the mean
+    DES_DISTS
+};
+
+// how fast each seat plays
+struct des_model {
+    enum des_dist dist;
+    double mean[4];             // mean think time per seat, in virtual ms
+};
+
+// a player's turn at a point in virtual time
+struct des_event {
+    double time;
+    uint64_t seq;               // order of scheduling, breaks ties
+    int seat;
+};
+
+// priority queue of events, earliest first
+struct des_queue {
+    struct des_event heap[4];   // at most one pending turn per seat
+    int n;
+    uint64_t seq;
+};
+
+// what a game took
+struct des_stats {
+    long events;                // turns taken
+    double time;                // virtual ms until the game ended
+};
+
+// name of a distribution, as accepted by des_dist_parse()
+const char *des_dist_name(enum des_dist dist);
+
+// look up a distribution by name; returns false if there is none
+bool des_dist_parse(const char *name, enum des_dist *dist);
+
+// draw a think time for `seat`
+double des_think(const struct des_model *model, int seat, struct rng *rng);
+
+// play `g`, which has been dealt and reset, with think times drawn from
+// `model` seeded by `seed`
+void game_play_des(struct game *g, const struct des_model *model, uint64_t seed,
+                   struct des_stats *stats, FILE *out);
+#endif /* des.h */
@@ -2,8 +2,8 @@
  * A multi-threaded simulation of the game "Dutchblitz"
  * (https://www.dutchblitz.com/)
  *
- * Player are threads and the game state is expressed in
- * global variables.
+ * Player are threads and the game state is kept in a struct game
+ * shared by the player threads; the rules are in game.c.
  *
  * The challenge is to ensure a consistent and fair game.
  *
@@ -21,538 +21,1475 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <sched.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
-#include "pile.h"
+#include "game.h"
+#include "solver.h"
+#include "mpmcq.h"
+#include "hist.h"
+#include "cards.h"
+#include "backoff.h"
+#include "wsdeque.h"
+#include "rng.h"
+#include "coro.h"
+#include "results.h"
+#include "perfctr.h"
+#include "des.h"
 
+FILE *logfile;  // logfile to write log output, or NULL
 
-#include "cards.h"
+struct timespec ts = {0, 1};
+
+// decide and commit each move in separate critical sections, so that
+// other players can get to the dutch piles in between and a decision
+// can go stale. Set with COMMIT=split, default COMMIT=locked.
+static bool split_commit;
+
+// post each turn to the game's flat combiner (combine.c), which decides
+// on and commits the moves of all players who posted a turn in a single
+// critical section. Each decision sees the moves committed before it in
+// the pass, so of two yellow 2s for one yellow 1 only the first is
+// played, and no decision goes stale. Set with COMMIT=combine.
+static bool combine_commits;
+static long combinepasses, combineops;      // over all games, accessed atomically
 
-/* A Fisher-Yates shuffle */
-static void 
-fisher_yates(uint8_t *deck, uint8_t n)
+/*
+ * Move tracing, enabled with TRACE=1. For every decision a player makes
+ * we record how long it took until the move was committed or found to
+ * be stale, and how long since the player's previous decision. Each
+ * player thread records into its own struct move_stats; they are added
+ * up per seat when the game is over and reported at the end.
+ */
+static bool trace_moves;
+
+struct move_stats {
+    long decisions;             // moves decided on
+    long committed;             // ... and made
+    long stale;                 // ... and no longer possible at commit
+    long stuck;                 // times no move was possible
+    uint64_t lastdecision;      // time of the previous decision, ns
+    struct hist commit;         // decision to commit or failure, ns
+    struct hist gap;            // between consecutive decisions, ns
+} __attribute__((aligned(64))); // written by one player thread each
+
+static struct move_stats seatstats[4];
+static pthread_mutex_t seatstatslock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+now_ns(void)
 {
-    for (int i = n-1; i > 0; i--) {
-        int j = random() % (i+1);
-        uint8_t tmp = deck[j];
-        deck[j] = deck[i];
-        deck[i] = tmp;
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static double
+now(void)
+{
+    return now_ns() * 1e-9;
+}
+
+static void
+move_stats_init(struct move_stats *stats)
+{
+    stats->decisions = stats->committed = stats->stale = stats->stuck = 0;
+    stats->lastdecision = 0;
+    hist_init(&stats->commit);
+    hist_init(&stats->gap);
 }
 
-/* Prepare a standard dutchblitz deck with a given bgcolor and shuffle it. */
 static void
-prepare_deck(uint8_t *deck, enum Color bgcolor)
+move_stats_record(struct move_stats *stats, enum move_result result,
+                  uint64_t decided, uint64_t done)
 {
-    for (int fgcolor = 0; fgcolor < 4; fgcolor++)
-        for (int num = 0; num < 10; num++)
-            deck[10*fgcolor + num] = make_card(bgcolor, fgcolor, num);
+    if (result == MOVE_NONE) {
+        stats->stuck++;
+        return;
+    }
+    stats->decisions++;
+    if (result == MOVE_COMMITTED)
+        stats->committed++;
+    else
+        stats->stale++;
+    hist_record(&stats->commit, done - decided);
+    if (stats->lastdecision)
+        hist_record(&stats->gap, decided - stats->lastdecision);
+    stats->lastdecision = decided;
+}
 
-    fisher_yates(deck, 40);
+// add a finished player's stats to those of its seat
+static void
+move_stats_add(int seat, struct move_stats *stats)
+{
+    pthread_mutex_lock(&seatstatslock);
+    struct move_stats *total = &seatstats[seat];
+    total->decisions += stats->decisions;
+    total->committed += stats->committed;
+    total->stale += stats->stale;
+    total->stuck += stats->stuck;
+    hist_merge(&total->commit, &stats->commit);
+    hist_merge(&total->gap, &stats->gap);
+    pthread_mutex_unlock(&seatstatslock);
 }
 
-// the play state of a player
-struct player_state {
-    uint8_t deck[40];           // deck from which the piles were dealt
-    struct pile woodpiledraw;   // wood pile in hand to draw from
-    struct pile woodpilediscard;// wood pile on table to discard to
-    struct pile post[3];        // post piles: stack
-    struct pile blitz;          // blitz pile: stack
-    uint8_t bgcolor;            // that player's bgcolor
-    const char *name;           // name of player based on background
-                                // color of their deck
-};
+// print the move stats of each seat, latencies in microseconds
+static void
+move_stats_report(FILE *out)
+{
+    fprintf(out, "%-6s %10s %10s %8s %7s %8s | %-29s | %-22s\n",
+            "seat", "decisions", "committed", "stale", "stale%", "stuck",
+            "decide->commit p50/p90/p99/max", "gap p50/p99/max");
+    for (int i = 0; i < 4; i++) {
+        struct move_stats *st = &seatstats[i];
+        struct hist *c = &st->commit, *g = &st->gap;
+        fprintf(out, "%-6s %10ld %10ld %8ld %6.2f%% %8ld | %6.1f %6.1f %6.1f %7.1f | %6.1f %6.1f %7.1f\n",
+                colors[i], st->decisions, st->committed, st->stale,
+                st->decisions ? 100.0 * st->stale / st->decisions : 0.0, st->stuck,
+                hist_percentile(c, 50) / 1e3, hist_percentile(c, 90) / 1e3,
+                hist_percentile(c, 99) / 1e3, c->max / 1e3,
+                hist_percentile(g, 50) / 1e3, hist_percentile(g, 99) / 1e3, g->max / 1e3);
+    }
+}
 
-struct player_state players[4]; // state of each player
-struct pile dutch[16];          // 16 dutch piles: 4 of each color (4x threads)
-int nextdutch = 0;              // index of next dutch pile to be started
-bool blitzed = false;           // true if someone blitzed in this game
-struct player_state *winner;    // winner who has blitzed
-int deadlocked = 0;             // how many players are currently deadlocked
-static _Thread_local const char *threadname;    // name of each player
+/*
+ * Performance counters, enabled with PERF=1; see perfctr.h for what is
+ * counted and how. They are read around each phase of a game: dealing
+ * and scoring on whichever thread does it, and playing on each player
+ * thread, counted for that player's seat. Player coroutines (MODE=coro)
+ * share the counters of their worker thread, so their playing is not
+ * counted, and in MODE=fork the counts stay in the worker processes.
+ */
+static bool perf_counters;
 
-// a barrier in an attempt to let threads start at roughly the same time
-static pthread_barrier_t readysetgo;   
+enum phase { PHASE_DEAL, PHASE_PLAY, PHASE_SCORE, PHASES };
+static const char *phasenames[PHASES] = { "deal", "play", "score" };
 
-FILE *logfile;  // logfile to write log output, or NULL
+static struct perf_total phaseperf[PHASES];     // PHASE_PLAY: see seatperf
+static struct perf_total seatperf[4];
+static pthread_mutex_t perflock = PTHREAD_MUTEX_INITIALIZER;
 
-pthread_mutex_t lock;
-struct timespec ts = {0, 1};
+// add what the calling thread counted since `begin` to `total`
+static void
+perf_account(const struct perf_sample *begin, struct perf_total *total)
+{
+    struct perf_sample end;
+    perf_read(&end);
+    pthread_mutex_lock(&perflock);
+    perf_add(total, begin, &end);
+    pthread_mutex_unlock(&perflock);
+}
 
 static void
-reset_simulation()
-{
-    winner = NULL;
-    deadlocked = 0;
-    blitzed = false;
-    nextdutch = 0;
-}
-
-const int BLITZED_FROM_POST = 256;  // player blitzed by moving cards to post pile
-const int PLAY_WOOD = 257;  // player is going to put a wood pile card to the dutch pile
-const int PLAY_BLITZ = 258; // player is going to put a blitz pile card to the dutch pile
-const int PLAY_POST = 259;  // player is going to put a post pile card to the dutch pile
-
-// check the consistency of the dutch piles started so far
-static void 
-validate_dutch()
-{
-    for (int i = 0; i < nextdutch; i++) {
-        for (int pos = 0; pos < pile_size(&dutch[i]); pos++) {
-            uint8_t cp = dutch[i]._cards[pos];
-            // check that dutch piles are in order 0, 1, 2 and have the
-            // same front color
-            assert (get_card_number(cp) == pos);        
-            assert (get_front_color(cp) == get_front_color(dutch[i]._cards[0]));
-        }
+perf_report_row(FILE *out, const char *name, struct perf_total *total)
+{
+    long n = total->intervals;
+    fprintf(out, "%-6s %8ld", name, n);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        double mean = n ? (double) total->value[c] / n : 0;
+        if (!perf_available(c))
+            fprintf(out, " %10s", "n/a");
+        else if (c == PERF_CPU_NS)
+            fprintf(out, " %10.3f", mean / 1e6);
+        else
+            fprintf(out, " %10.0f", mean);
     }
+    if (perf_available(PERF_CYCLES) && total->value[PERF_CYCLES])
+        fprintf(out, " %5.2f", (double) total->value[PERF_INSTRUCTIONS] / total->value[PERF_CYCLES]);
+    fprintf(out, "\n");
 }
 
-// output dutch piles' content to file
+// print the counts per game of each phase, and of each seat's playing
 static void
-dump_dutch(FILE *out, bool full)
+perf_report(FILE *out)
 {
-    fprintf(out, "Dutch pile sizes:");
-    for (int i = 0; i < nextdutch; i++)
-        fprintf(out, " %2d", pile_size(&dutch[i]));
-    fprintf(out, "\n");
-    if (full) {
-        for (int i = 0; i < nextdutch; i++) {
-            pile_dump(dutch+i, out);
-            fprintf(out, "\n");
-        }
+    fprintf(out, "%-6s %8s", "phase", "games");
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        fprintf(out, " %10s", perf_counter_name(c));
+    fprintf(out, " %5s\n", "IPC");
+
+    // playing is counted by seat; every seat plays once per game
+    struct perf_total play = { .intervals = seatperf[0].intervals };
+    for (int i = 0; i < 4; i++)
+        for (int c = 0; c < PERF_COUNTERS; c++)
+            play.value[c] += seatperf[i].value[c];
+    phaseperf[PHASE_PLAY] = play;
+
+    for (int p = 0; p < PHASES; p++)
+        perf_report_row(out, phasenames[p], &phaseperf[p]);
+    for (int i = 0; i < 4; i++) {
+        char name[16];
+        snprintf(name, sizeof name, "play %s", colors[i]);
+        perf_report_row(out, name, &seatperf[i]);
     }
+    fprintf(out, "from perf events:");
+    for (int c = 0; c < PERF_COUNTERS; c++)
+        if (perf_from_events(c))
+            fprintf(out, " %s", perf_counter_name(c));
+    fprintf(out, "%s\n", perf_from_events(PERF_CONTEXT_SWITCHES) ? ""
+                         : "; context switches from getrusage");
 }
 
-// does card fit on dutch pile? 
-// if `play` is true, card will be added to dutch pile on which it fits
-// return true/false
-static bool
-fits_on_dutch_pile(uint8_t card, bool play, FILE *out)
-{
-    if (get_card_number(card) == 0) {
-        if (play) {
-            assert(nextdutch < 16);
-            pile_init(&dutch[nextdutch], 10);
-            pile_push(&dutch[nextdutch], card);
-            if (out) {
-                fprintf(out, "%s puts ", threadname);
-                print_card(card, false, out);
-                fprintf(out, " on dutch\n");
-            }
-            nextdutch++;
-        }
+// a turn posted to the flat combiner with COMMIT=combine
+struct turn_op {
+    struct game *game;
+    struct player_state *player;
+    FILE *out;
+};
+
+// decide on and commit a posted turn's move; run by the combiner under
+// the game lock. A player without a move is marked stuck on the dutch
+// piles it searched.
+static int
+turn_op_run(void *arg)
+{
+    struct turn_op *op = arg;
+    struct game *g = op->game;
+    uint32_t action = player_decide_move(g, op->player, op->out);
+    enum move_result result = player_commit_move(g, op->player, action, op->out);
+    if (result == MOVE_NONE && !game_over(g))
+        player_mark_deadlocked(g, op->player);
+    return result;
+}
+
+// arguments of a player thread
+struct player_thread {
+    struct game *game;
+    struct player_state *player;
+    struct move_stats stats;    // if trace_moves
+};
+
+// what players do between turns. Set with BACKOFF=nanosleep|pause|exp|yield|random
+static enum backoff_kind backoff_kind = BACKOFF_NANOSLEEP;
 
-        return true;
-    }
-
-    for (int i = 0; i < nextdutch; i++) {
-        uint8_t dtopcard = pile_top(&dutch[i]);
-        if (get_card_number(card) == get_card_number(dtopcard) + 1
-            && get_front_color(card) == get_front_color(dtopcard))
-        {
-            if (play) {
-                pile_push(&dutch[i], card);
-                if (out) {
-                    fprintf(out, "%s puts ", threadname);
-                    print_card(card, false, out);
-                    fprintf(out, "on dutch\n");
-                }
+// try to take a turn and return true if the game is not over yet
+bool
+player_can_take_turns_and_game_not_over(struct game *g, struct player_state *player,
+                                        struct backoff *backoff, struct move_stats *stats,
+                                        FILE *out)
+{
+    while (!game_over(g)) {
+        uint64_t decided;
+        enum move_result result;
+        if (combine_commits) {
+            // decided and committed in one pass of the combiner; traced
+            // from when the turn is posted
+            decided = trace_moves ? now_ns() : 0;
+            struct turn_op op = { g, player, out };
+            result = combine(&g->combiner, &g->lock, player->bgcolor, turn_op_run, &op);
+        } else {
+            game_lock(&g->lock);
+            uint32_t action = player_decide_move(g, player, out);
+            decided = trace_moves ? now_ns() : 0;
+            if (split_commit && action != -1) {
+                game_unlock(&g->lock);
+                if (coro_current())
+                    coro_yield();
+                else
+                    nanosleep(&ts, NULL);
+                game_lock(&g->lock);
             }
-            return true;
+            result = player_commit_move(g, player, action, out);
+            // mark the player stuck on the dutch piles it just searched,
+            // before another player gets the lock and changes them
+            if (result == MOVE_NONE && !game_over(g))
+                player_mark_deadlocked(g, player);
+            game_unlock(&g->lock);
         }
+        if (trace_moves)
+            move_stats_record(stats, result, decided, now_ns());
+        if (result == MOVE_COMMITTED)
+            backoff_reset(backoff);
+        backoff_wait(backoff);
+        if (result == MOVE_NONE)
+            break;
     }
-    return false;
+    return !game_over(g);
 }
 
-// print this player's state.
-// should be called only if out != NULL
-static void
-player_print_state(struct player_state *player, FILE *out)
+// main player function
+void *
+player_function(void *_arg)
 {
-    fprintf(out, "Piles for player %s\n", player->name); 
-    fprintf(out, "Blitzpile: ");
-    pile_dump(&player->blitz, out); 
-    fprintf(out, "\n");
-    for (int i = 0; i < 3; i++) {
-        fprintf(out, "Postpile#%d: ", i);
-        pile_dump(&player->post[i], out); 
-        fprintf(out, "\n");
-    }
-    fprintf(out, "Total cards in wood piles %d\n", 
-        pile_size(&player->woodpilediscard) + pile_size(&player->woodpiledraw));
-    fprintf(out, "Woodpile (discard): ");
-    pile_dump(&player->woodpilediscard, out); 
-    fprintf(out, "\n");
-    fprintf(out, "Woodpile (draw): ");
-    pile_dump(&player->woodpiledraw, out); 
-    fprintf(out, "\n");
+    struct player_thread *arg = _arg;
+    struct game *g = arg->game;
+    struct player_state *player = arg->player;
+    struct backoff backoff;
+    backoff_init(&backoff, backoff_kind, (uintptr_t) &backoff);
+
+    // this barrier allows threads to start at about the same time.
+    // Coroutines of a game start together anyway.
+    if (!coro_current())
+        pthread_barrier_wait(&g->readysetgo);
+    struct perf_sample start;
+    bool counted = perf_counters && !coro_current();
+    if (counted)
+        perf_read(&start);
+    //pthread_mutex_lock(&lock);
+    while (player_can_take_turns_and_game_not_over(g, player, &backoff, &arg->stats, logfile)) {
+        // this player cannot make a turn right now, but the game is also
+        // not over. It has been marked as deadlocked - once all 4 players
+        // deadlock (which occurs rarely, but does happen), the game is over
+        backoff_wait(&backoff);
+    }
+    //pthread_mutex_unlock(&lock);
+    if (counted)
+        perf_account(&start, &seatperf[player->bgcolor]);
+    return NULL;
 }
 
-// validate single post pile consistency
-static void 
-validate_post_pile(struct pile *pile)
+// validate every n-th game, 0 for never. Set with VALIDATE=all|none|<n>
+static int validate_every = 64;
+
+// also check on every validated deal that the game can be snapshotted,
+// saved, loaded and played on (validate_snapshot_restore()). That plays
+// three more games, so it is done only when VALIDATE is set explicitly.
+static bool validate_snapshots;
+
+// implementation of the game lock. Set with LOCK=pthread|fair|ticket|barge|spin
+static enum game_lock_kind lock_kind = GAME_LOCK_PTHREAD;
+
+// set up `g` to be played from the dealt state `deal`
+static void
+game_begin(struct game *g, const struct game_state *deal, struct player_thread args[4])
 {
-    for (int i = pile->top - 1; i > 0; i--) {
-        uint8_t c1 = pile->_cards[i];
-        uint8_t c2 = pile->_cards[i-1];
-        assert(opposite_colors(get_front_color(c1), get_front_color(c2)));
-        assert(get_card_number(c1) + 1 == get_card_number(c2));
-        assert(get_back_color(c1) == get_back_color(c2));
+    game_reset(g);
+    game_state_copy(&g->state, deal);
+    game_lock_init(&g->lock, lock_kind);
+    combiner_init(&g->combiner);
+    pthread_barrier_init(&g->readysetgo, NULL, 4);
+
+    uint8_t startorder[4] = {0, 1, 2, 3};
+    //fisher_yates(startorder, 4);
+    for (int i = 0; i < 4; i++) {
+        args[i].game = g;
+        args[i].player = &g->state.players[startorder[i]];
+        if (trace_moves)
+            move_stats_init(&args[i].stats);
     }
 }
 
-// validate post piles consistency
+// once all players of game number `game` are done, write its outcome to `result`
 static void
-validate_post_piles(struct player_state *player)
+game_end(struct game *g, int game, struct player_thread args[4],
+         struct game_result *result, FILE *out)
 {
-    for (int i = 0; i < 3; i++)
-        if (!pile_empty(&player->post[i]))
-            validate_post_pile(&player->post[i]);
+    if (trace_moves)
+        for (int i = 0; i < 4; i++)
+            move_stats_add(args[i].player->bgcolor, &args[i].stats);
+
+    pthread_barrier_destroy(&g->readysetgo);
+    game_lock_destroy(&g->lock);
+    __atomic_fetch_add(&combinepasses, g->combiner.passes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&combineops, g->combiner.ops, __ATOMIC_RELAXED);
+
+    struct perf_sample start;
+    if (perf_counters)
+        perf_read(&start);
+
+    // all players are done, so the state can be checked without racing.
+    // Players may have rearranged their own piles after the game ended,
+    // before they noticed, so the outcome comes from the snapshot taken
+    // when it ended.
+    struct game_state *gs = &g->final;
+    struct player_state *winner = g->blitzed ? &gs->players[g->winner - g->state.players] : NULL;
+    if (validate_every > 0 && game % validate_every == 0) {
+        validate_game(gs);
+        if (!g->blitzed)
+            validate_stuck(g);
+    }
+
+    global_state_on_win(gs, winner, out);
+    score_all_players(gs, result->scores, out);
+    if (perf_counters)
+        perf_account(&start, &phaseperf[PHASE_SCORE]);
+    result->winner = g->blitzed ? g->winner->bgcolor : -1;
+    result->moves = g->moves;
+    result->end = g->blitzed ? GAME_BLITZED : GAME_STUCK;
 }
 
-// validate (and possibly output) global state when someone blitzed
+// simulate a full game from the dealt state `deal` and write its outcome to `result`
 static void
-global_state_on_win(struct player_state *winner, FILE *out)
+simulate_one_game(int game, const struct game_state *deal, struct game_result *result, FILE *out)
 {
+    struct game g;
+    pthread_t t[4];
+    struct player_thread args[4];
+    game_begin(&g, deal, args);
+
     for (int i = 0; i < 4; i++) {
-        validate_post_piles(&players[i]);
+        int rc = pthread_create(&t[i], NULL, player_function, &args[i]);
+        if (rc != 0) {
+            errno = rc;
+            perror("pthread_create");
+        }
     }
-    validate_dutch();
 
-    if (out) {
-        if (winner) {
-            fprintf(out, "Winner is:  %s\n", winner->name);
-            player_print_state(winner, out);
-            fprintf(out, "\nOther players:\n"); 
-        } else {
-            fprintf(out, "There was no winner:\n"); 
-        }
-        for (int i = 0; i < 4; i++) 
-            if (players + i != winner) {
-                player_print_state(&players[i], out);
-                fprintf(out, "\n");
-            }
-        dump_dutch(out, winner == NULL);
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(t[i], NULL);
     }
+
+    game_end(&g, game, args, result, out);
 }
 
-// prepare a player's deck by dealing blitz, post, and wood piles
+// progress of a batch of games, saved so an interrupted batch can resume
+struct checkpoint {
+    uint64_t seed;      // seed of the batch; game i is dealt from seed + i
+    int ngames;         // games in the batch
+    int done;           // games completed
+    int total_scores[4];
+    int wins[4];        // games won by each seat
+};
+
+// save batch progress, replacing the checkpoint file atomically
 static void
-player_deal(struct player_state *player)
-{
-    prepare_deck(player->deck, player->bgcolor);
-
-    int nextcard = 0;
-    for (int i = 0; i < 3; i++) {
-        pile_init(&player->post[i], 10);
-        pile_push(&player->post[i], player->deck[nextcard++]);
-    }
-    pile_init(&player->blitz, 10);
-    for (int i = 0; i < 10; i++) {
-        pile_push(&player->blitz, player->deck[nextcard++]);
-    }
-    pile_init(&player->woodpiledraw, 30);
-    pile_init(&player->woodpilediscard, 30);
-    for (int i = 0; i < 27; i++) {
-        pile_push(&player->woodpiledraw, player->deck[nextcard++]);
-    }
-}
-
-// Play my deck, being able to read from, but not write to,
-// the dutch piles
-// Returns 
-//  - a 1 card to put on dutch pile if one is available to play
-//  - PLAY_BLITZ or PLAY_POST+0, +1, +2 if an attempt should be made to
-//      play blitz or the first, second, or third post pile.
-//  - PLAY_WOOD if the top of the wood pile can be dutched
-//
-//  -1 if no actions are possible until something moves in the dutch piles
-static uint32_t
-player_find_possible_move(struct player_state *player, FILE *out)
-{
-    const int NROUNDS = 500;
-    int resetsleft = 3;
-
-    for (int rounds = 0; rounds < NROUNDS; rounds++) {
-        // check if any blitz card can be put on the dutch pile
-        if (!pile_empty(&player->blitz) && fits_on_dutch_pile(pile_top(&player->blitz), false, out))
-            return PLAY_BLITZ;
-
-        // check if any post pile cards can be placed onto the dutch pile
-        for (int j = 0; j < 3; j++) {
-            if (!pile_empty(&player->post[j])) {
-                if (fits_on_dutch_pile(pile_top(&player->post[j]), false, out))
-                    return PLAY_POST + j;
-            }
-        }
+checkpoint_save(const char *path, struct checkpoint *cp)
+{
+    char tmp[strlen(path) + 5];
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror(tmp);
+        return;
+    }
+    fprintf(f, "dutchblitz-checkpoint %llu %d %d %d %d %d %d %d %d %d %d\n",
+            (unsigned long long) cp->seed, cp->ngames, cp->done,
+            cp->total_scores[0], cp->total_scores[1],
+            cp->total_scores[2], cp->total_scores[3],
+            cp->wins[0], cp->wins[1], cp->wins[2], cp->wins[3]);
+    if (fclose(f) != 0 || rename(tmp, path) != 0)
+        perror(path);
+}
 
-        // see if any blitz cards can be moved onto post pile.
-        bool moved = true;
-        while (moved) {
-            moved = false;
-            for (int i = 0; !pile_empty(&player->blitz) && i < 3; i++) {
-                uint8_t btopcard = pile_top(&player->blitz);
-                if (pile_empty(&player->post[i])) {
-                    pile_push(&player->post[i], pile_pop(&player->blitz));
-                    moved = true;
-                } else {
-                    uint8_t to = pile_top(&player->post[i]);
-                    if (get_card_number(to) == get_card_number(btopcard) + 1
-                        && opposite_colors(get_front_color(btopcard), get_front_color(to))) {
-                        pile_push(&player->post[i], pile_pop(&player->blitz));
-                        moved = true;
-                    }
-                }
-            }
-        }
-        if (pile_empty(&player->blitz))
-            return BLITZED_FROM_POST;
-
-        // now we have a choice to make - serve the wood pile first,
-        // or try to consolidate the post piles.
-        //
-        // Check if post piles can be consolidated, starting with 
-        // the post pile with the highest number.
-        // For instance, if we have 3red, 4yellow, 5red we want to
-        // move 4yellow onto 5red first, then 3red onto 4yellow.
-        for (int cnum = 8; cnum >= 1; cnum--) {
-            for (int i = 0; i < 3; i++) {
-                if (pile_size(&player->post[i]) == 1) { // can move only single cards
-                    uint8_t from = pile_top(&player->post[i]);
-                    if (get_card_number(from) == cnum) {
-                        for (int j = 0; j < 3; j++) if (i != j) {
-                            if (pile_size(&player->post[j]) == 1) {
-                                uint8_t to = pile_top(&player->post[j]);
-                                if (get_card_number(to) == cnum + 1 
-                                    && opposite_colors(get_front_color(from), get_front_color(to))) {
-                                    pile_push(&player->post[j], pile_pop(&player->post[i]));
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
+// load batch progress; returns false if there is no usable checkpoint
+static bool
+checkpoint_load(const char *path, struct checkpoint *cp)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+    // parsed aside, so that a file that is not a checkpoint leaves `cp` alone
+    struct checkpoint loaded;
+    unsigned long long seed;
+    int n = fscanf(f, "dutchblitz-checkpoint %llu %d %d %d %d %d %d %d %d %d %d",
+                   &seed, &loaded.ngames, &loaded.done,
+                   &loaded.total_scores[0], &loaded.total_scores[1],
+                   &loaded.total_scores[2], &loaded.total_scores[3],
+                   &loaded.wins[0], &loaded.wins[1], &loaded.wins[2], &loaded.wins[3]);
+    fclose(f);
+    if (n != 11)
+        return false;
+    loaded.seed = seed;
+    *cp = loaded;
+    return true;
+}
 
-        if (pile_size(&player->woodpiledraw) == 0 && pile_size(&player->woodpilediscard) == 0) {
-            if (out)
-                fprintf(out, "player %s ran out of wood piles\n", player->name);
-            return -1;
-        }
+// save a checkpoint after this many games
+static const int CHECKPOINT_INTERVAL = 100;
 
-        // now it's time to sift through the wood pile. We must go in steps of 3.
-        // we may run out at any step and may need to flip the woodpile draw over 
-        for (int i = 0; i < 3; i++) {
-            // replenish drawing pile from discard pile if out of drawing cards
-            if (pile_size(&player->woodpiledraw) == 0) {
-                while (pile_size(&player->woodpilediscard) > 0) {
-                    pile_push(&player->woodpiledraw, pile_pop(&player->woodpilediscard));
-                }
-            }
-            // flip card over
-            pile_push(&player->woodpilediscard, pile_pop(&player->woodpiledraw));
+// per-game results are appended here if RESULTS is set
+static struct results_file *resultsfile;
+
+// mean and variance of a stream of values, by Welford's algorithm
+struct running_stats {
+    long n;
+    double mean;
+    double m2;          // sum of squared differences from the mean
+};
+
+static void
+running_add(struct running_stats *rs, double x)
+{
+    rs->n++;
+    double delta = x - rs->mean;
+    rs->mean += delta / rs->n;
+    rs->m2 += delta * (x - rs->mean);
+}
+
+// half the width of the 95% confidence interval of the mean
+static double
+running_halfwidth(const struct running_stats *rs)
+{
+    if (rs->n < 2)
+        return INFINITY;
+    return 1.96 * sqrt(rs->m2 / (rs->n - 1) / rs->n);
+}
+
+// scores of each seat over the games reduced so far
+static struct running_stats seatscores[4];
+
+// seed of game `game` of the batch: `seeds` lists them, or if NULL,
+// game i is dealt from cp->seed + i
+static uint64_t
+batch_seed(struct checkpoint *cp, const uint64_t *seeds, int game)
+{
+    return seeds ? seeds[game] : cp->seed + game;
+}
+
+// deal game `game` of the batch into `deal`
+static void
+batch_deal(struct checkpoint *cp, const uint64_t *seeds, int game, struct game_state *deal)
+{
+    struct perf_sample start;
+    if (perf_counters)
+        perf_read(&start);
+    game_deal(deal, batch_seed(cp, seeds, game));
+    if (perf_counters)
+        perf_account(&start, &phaseperf[PHASE_DEAL]);
+    if (validate_snapshots && game % validate_every == 0)
+        validate_snapshot_restore(deal);
+}
+
+// add the outcome of the next game of the batch, in order, and save
+// a checkpoint every CHECKPOINT_INTERVAL games. The results file is
+// flushed first, so it never misses a game the checkpoint counts; if
+// the batch is interrupted between the two, the games played since the
+// previous checkpoint are appended again when it resumes.
+static void
+batch_add(struct checkpoint *cp, const uint64_t *seeds, struct game_result *result,
+          const char *checkpoint)
+{
+    if (resultsfile)
+        results_append(resultsfile, batch_seed(cp, seeds, cp->done), result);
+    for (int j = 0; j < 4; j++)
+        cp->total_scores[j] += result->scores[j];
+    if (result->end != GAME_FAILED)
+        for (int j = 0; j < 4; j++)
+            running_add(&seatscores[j], result->scores[j]);
+    if (result->winner >= 0)
+        cp->wins[result->winner]++;
+    cp->done++;
+    if (checkpoint && (cp->done % CHECKPOINT_INTERVAL == 0 || cp->done == cp->ngames)) {
+        if (resultsfile)
+            results_flush(resultsfile);
+        checkpoint_save(checkpoint, cp);
+    }
+}
+
+// deal and play the rest of the batch, one game at a time.
+// Returns the number of moves committed.
+static long
+run_batch(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint)
+{
+    long moves = 0;
+    for (int i = cp->done; i < cp->ngames; i++) {
+        struct game_state deal;
+        struct game_result result;
+        batch_deal(cp, seeds, i, &deal);
+        simulate_one_game(i, &deal, &result, logfile);
+        moves += result.moves;
+        batch_add(cp, seeds, &result, checkpoint);
+    }
+    return moves;
+}
+
+/*
+ * MODE=pipeline: the batch runs in three stages connected by bounded
+ * lock-free queues, so that dealing never delays a game.
+ *
+ *   producers (PRODUCERS, default 1) deal games into `dealt`
+ *   workers (WORKERS, default one per CPU) play them, into `played`
+ *   the main thread reduces the scores in game order
+ *
+ * The stages pass around a fixed set of deal buffers, which go back to
+ * the producers through `empty` once reduced. With 4 buffers per
+ * worker, producers stay ahead of the workers without dealing the
+ * whole batch up front.
+ */
+
+// buffers per worker
+static const int PIPELINE_DEPTH = 4;
+
+// a game travelling through the pipeline
+struct deal {
+    int game;                   // index in the batch
+    struct game_state state;    // as dealt
+    struct game_result result;  // once played
+};
+
+struct pipeline {
+    struct checkpoint *cp;
+    const uint64_t *seeds;      // as for run_batch()
+    struct mpmc_queue *empty;   // buffers for the producers
+    struct mpmc_queue *dealt;   // dealt games for the workers
+    struct mpmc_queue *played;  // played games for the reducer
+    int nextgame;               // next game to be dealt
+    int undealt;                // games not yet taken by a worker
+};
+
+// stages yield the CPU while their input queue is empty
+static void *
+pipeline_pop(struct mpmc_queue *q)
+{
+    void *item;
+    while ((item = mpmc_pop(q)) == NULL)
+        sched_yield();
+    return item;
+}
+
+// every queue can hold every buffer, so a push cannot fail
+static void
+pipeline_push(struct mpmc_queue *q, struct deal *d)
+{
+    bool ok = mpmc_push(q, d);
+    assert(ok);
+    (void) ok;
+}
+
+static void *
+pipeline_producer(void *_arg)
+{
+    struct pipeline *p = _arg;
+    for (;;) {
+        // take a buffer before a game, so that every game handed out
+        // but not yet reduced holds a buffer
+        struct deal *d = pipeline_pop(p->empty);
+        int game = __atomic_fetch_add(&p->nextgame, 1, __ATOMIC_RELAXED);
+        if (game >= p->cp->ngames) {
+            pipeline_push(p->empty, d);
+            return NULL;
         }
+        d->game = game;
+        batch_deal(p->cp, p->seeds, game, &d->state);
+        pipeline_push(p->dealt, d);
+    }
+}
 
-        // now check if the top card of the woodpile discard can be put on the dutch pile.
-        if (fits_on_dutch_pile(pile_top(&player->woodpilediscard), false, out))
-            return PLAY_WOOD;
-
-        // at this point, we could try to place the top of the wood pile onto
-        // a post pile.  However, this is risky - the rules manual actually advises
-        // against it since it pads the post piles, making it less likely to accommodate
-        // cards from the blitz pile.  But it may be needed to get a game unstuck,
-        // particularly if the number of cards on the wood post pile is a multiple
-        // of 3, that is, only 1/3 of the cards are looked at.
-        // let's do that only after we've played through the complete woodpile at least once.
-        //
-        if (rounds > (pile_size(&player->woodpiledraw) + pile_size(&player->woodpilediscard))) {
-            uint8_t wtopcard = pile_top(&player->woodpilediscard);
-
-            for (int i = 0; i < 3; i++) {
-                // should not be empty since we would have placed blitz card here
-                assert (!pile_empty(&player->post[i]));
-
-                uint8_t to = pile_top(&player->post[i]);
-                if (get_card_number(to) == get_card_number(wtopcard) + 1
-                    && opposite_colors(get_front_color(wtopcard), get_front_color(to))) {
-                    pile_push(&player->post[i], pile_pop(&player->woodpilediscard));
-                    break;
-                }
-            }
+static void *
+pipeline_worker(void *_arg)
+{
+    struct pipeline *p = _arg;
+    while (__atomic_sub_fetch(&p->undealt, 1, __ATOMIC_RELAXED) >= 0) {
+        struct deal *d = pipeline_pop(p->dealt);
+        simulate_one_game(d->game, &d->state, &d->result, logfile);
+        pipeline_push(p->played, d);
+    }
+    return NULL;
+}
+
+static int
+env_int(const char *name, int dflt)
+{
+    char *value = getenv(name);
+    return value && atoi(value) > 0 ? atoi(value) : dflt;
+}
+
+// play the rest of the batch in a deal/play/reduce pipeline.
+// With more than one worker, games write their log output concurrently.
+// Returns the number of moves committed.
+static long
+run_pipeline(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint,
+             int nproducers, int nworkers)
+{
+    int nbuffers = nworkers * PIPELINE_DEPTH;
+    long moves = 0;
+
+    struct pipeline p = {
+        .cp = cp,
+        .seeds = seeds,
+        .empty = mpmc_new(nbuffers),
+        .dealt = mpmc_new(nbuffers),
+        .played = mpmc_new(nbuffers),
+        .nextgame = cp->done,
+        .undealt = cp->ngames - cp->done,
+    };
+    struct deal *buffers = aligned_alloc(64, sizeof(struct deal) * nbuffers);
+    for (int i = 0; i < nbuffers; i++)
+        pipeline_push(p.empty, &buffers[i]);
+
+    pthread_t producers[nproducers], workers[nworkers];
+    for (int i = 0; i < nproducers; i++)
+        pthread_create(&producers[i], NULL, pipeline_producer, &p);
+    for (int i = 0; i < nworkers; i++)
+        pthread_create(&workers[i], NULL, pipeline_worker, &p);
+
+    // games finish out of order. Every game between the next one to be
+    // reduced and the newest one handed out holds a buffer, so a window
+    // of nbuffers games is enough to put them back in order.
+    struct deal *window[nbuffers];
+    memset(window, 0, sizeof window);
+    while (cp->done < cp->ngames) {
+        struct deal *d = pipeline_pop(p.played);
+        window[d->game % nbuffers] = d;
+        while ((d = window[cp->done % nbuffers]) != NULL) {
+            window[cp->done % nbuffers] = NULL;
+            moves += d->result.moves;
+            batch_add(cp, seeds, &d->result, checkpoint);
+            pipeline_push(p.empty, d);
         }
+    }
 
-        // As the rules say, if a player believes they are stuck, they can move the top 
-        // of the wood discard pile and place it on the bottom.
-        // we do this only after having recycle the wood pile a few times
-        if (rounds > 2 * (pile_size(&player->woodpiledraw) + pile_size(&player->woodpilediscard))) {
-            if (!pile_empty(&player->woodpiledraw))
-                if (resetsleft > 0) {
-                    pile_rotate_top_card_down(&player->woodpiledraw);
-                    resetsleft--;
-                    rounds = 0;
-                }
+    for (int i = 0; i < nproducers; i++)
+        pthread_join(producers[i], NULL);
+    for (int i = 0; i < nworkers; i++)
+        pthread_join(workers[i], NULL);
+    mpmc_free(p.empty);
+    mpmc_free(p.dealt);
+    mpmc_free(p.played);
+    free(buffers);
+    return moves;
+}
+
+/*
+ * MODE=steal: WORKERS threads play the batch, each from its own
+ * work-stealing deque of games. The games are dealt out round-robin up
+ * front, so every worker starts on the oldest games of its share. A
+ * worker that runs out steals from the top of a random other worker's
+ * deque, i.e. from the far end of that worker's share, so that a few
+ * long games do not leave the other workers idle at the end.
+ *
+ * The main thread adds up the results in game order as they finish,
+ * and reports how busy each worker was.
+ */
+
+// add up the outcomes of the rest of the batch in game order while
+// other threads play them. `results` and `finished` are indexed by
+// game - cp->done; a game's result is valid once finished[] is set.
+// Returns the number of moves committed.
+static long
+reduce_finished(struct checkpoint *cp, const uint64_t *seeds, struct game_result *results,
+                bool *finished, const char *checkpoint)
+{
+    int first = cp->done;
+    long moves = 0;
+    struct timespec poll = { 0, 100000 };
+    while (cp->done < cp->ngames) {
+        int i = cp->done - first;
+        if (__atomic_load_n(&finished[i], __ATOMIC_ACQUIRE)) {
+            moves += results[i].moves;
+            batch_add(cp, seeds, &results[i], checkpoint);
+        } else {
+            nanosleep(&poll, NULL);
         }
     }
-    // we run out of rounds - we conclude that we must wait for some action on the dutch piles
-    return -1;
+    return moves;
 }
 
-// try to play your pile and make up to one move related to the dutch pile
-// return true if a move was made
-//        false if no move could be made
-//
-// May set blitzed if move led to this player blitzing
+struct steal_run;
+
+struct steal_worker {
+    pthread_t tid;
+    struct steal_run *run;
+    int id;
+    struct ws_deque *deque;
+    struct rng rng;             // picks victims
+    long games;                 // games played
+    long stolen;                // ... of which were stolen
+    double busy;                // seconds spent playing
+};
+
+struct steal_run {
+    struct checkpoint *cp;
+    const uint64_t *seeds;      // as for run_batch()
+    int first;                  // first game of this run
+    int nworkers;
+    struct steal_worker *workers;
+    struct game_result *results;    // by game - first
+    bool *finished;                 // by game - first, accessed atomically
+    int unclaimed;                  // games not yet taken by any worker
+};
+
+// steal a game from another worker; false once all games are taken
 static bool
-player_try_to_make_one_move(struct player_state *player, FILE *out)
-{
-    uint32_t action = player_find_possible_move(player, out);
-    bool iblitzed = false;
-    bool madeplay = false;
-    if (action == -1) {
-        if (out)
-            fprintf(out, "player %s stuck deadlocked %d\n", player->name, deadlocked);
-    } else {
-        if (action == BLITZED_FROM_POST) {
-            iblitzed = true;
-        } else
-        if (action == PLAY_WOOD) {
-            if (fits_on_dutch_pile(pile_top(&player->woodpilediscard), true, out)) {
-                pile_pop(&player->woodpilediscard);
-                madeplay = true;
-            }
-        } else
-        if (action == PLAY_BLITZ) {
-            if (fits_on_dutch_pile(pile_top(&player->blitz), true, out)) {
-                pile_pop(&player->blitz);
-                if (pile_empty(&player->blitz)) {
-                    iblitzed = true;
-                }
-                madeplay = true;
-            }
-        } else 
-        if (PLAY_POST <= action && action <= PLAY_POST + 2) {
-            if (fits_on_dutch_pile(pile_top(&player->post[action-PLAY_POST]), true, out)) {
-                pile_pop(&player->post[action-PLAY_POST]);
-                madeplay = true;
-            }
-        }
+steal_game(struct steal_worker *w, long *game)
+{
+    struct steal_run *run = w->run;
+    while (__atomic_load_n(&run->unclaimed, __ATOMIC_RELAXED) > 0) {
+        int victim = rng_below(&w->rng, run->nworkers);
+        if (victim != w->id
+            && ws_steal(run->workers[victim].deque, game) == WS_STOLEN)
+            return true;
+        sched_yield();
+    }
+    return false;
+}
 
-        if (iblitzed && !blitzed) {
-            blitzed = true;
-            winner = player;
-            madeplay = true;
+static void *
+steal_worker(void *_arg)
+{
+    struct steal_worker *w = _arg;
+    struct steal_run *run = w->run;
+    long game;
+    for (;;) {
+        if (!ws_take(w->deque, &game)) {
+            if (!steal_game(w, &game))
+                break;
+            w->stolen++;
         }
+        __atomic_fetch_sub(&run->unclaimed, 1, __ATOMIC_RELAXED);
+
+        double start = now();
+        struct game_state deal;
+        batch_deal(run->cp, run->seeds, game, &deal);
+        simulate_one_game(game, &deal, &run->results[game - run->first], logfile);
+        w->busy += now() - start;
+        w->games++;
+        __atomic_store_n(&run->finished[game - run->first], true, __ATOMIC_RELEASE);
     }
-    return madeplay;
+    return NULL;
 }
 
-// try to take a turn and return true if the game is not over yet
-bool
-player_can_take_turns_and_game_not_over(struct player_state *player, FILE *out)
-{
-    while (!blitzed) {
-        pthread_mutex_lock(&lock);
-        bool madeplay = player_try_to_make_one_move(player, out);
-        pthread_mutex_unlock(&lock);
-        nanosleep(&ts, NULL);
-        if (madeplay) {
-            if (player == winner)
-                global_state_on_win(player, out);
-        } else {
-            break;
-        }
+// play the rest of the batch on `nworkers` work-stealing workers.
+// Returns the number of moves committed.
+static long
+run_steal(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint, int nworkers)
+{
+    int ngames = cp->ngames - cp->done;
+    struct steal_worker workers[nworkers];
+    struct steal_run run = {
+        .cp = cp,
+        .seeds = seeds,
+        .first = cp->done,
+        .nworkers = nworkers,
+        .workers = workers,
+        .results = malloc(sizeof(struct game_result) * ngames),
+        .finished = calloc(ngames, sizeof(bool)),
+        .unclaimed = ngames,
+    };
+
+    for (int i = 0; i < nworkers; i++) {
+        workers[i] = (struct steal_worker) { .run = &run, .id = i };
+        workers[i].deque = ws_new((ngames + nworkers - 1) / nworkers);
+        rng_seed(&workers[i].rng, i);
+    }
+    // newest first, so that each worker takes the oldest of its games first
+    for (int i = ngames - 1; i >= 0; i--) {
+        bool ok = ws_push(workers[i % nworkers].deque, run.first + i);
+        assert(ok);
+        (void) ok;
+    }
+
+    double start = now();
+    for (int i = 0; i < nworkers; i++)
+        pthread_create(&workers[i].tid, NULL, steal_worker, &workers[i]);
+
+    long moves = reduce_finished(cp, seeds, run.results, run.finished, checkpoint);
+    for (int i = 0; i < nworkers; i++)
+        pthread_join(workers[i].tid, NULL);
+    double elapsed = now() - start;
+
+    fprintf(stderr, "%-6s %8s %8s %9s %6s\n", "worker", "games", "stolen", "busy s", "util%");
+    for (int i = 0; i < nworkers; i++) {
+        fprintf(stderr, "%-6d %8ld %8ld %9.3f %6.1f\n", i, workers[i].games,
+                workers[i].stolen, workers[i].busy, 100 * workers[i].busy / elapsed);
+        ws_free(workers[i].deque);
     }
-    return !blitzed;
+    free(run.results);
+    free(run.finished);
+    return moves;
 }
 
-// main player function
-void *
-player_function(void *_arg)
+/*
+ * MODE=coro: players are coroutines rather than threads. WORKERS
+ * threads each run a coroutine scheduler (coro.c) with up to CORO_GAMES
+ * games at once, default 64, whose 4 * CORO_GAMES players take turns
+ * on that thread. A game keeps its slot until its last player is done;
+ * that player then starts the next game in the same slot.
+ *
+ * All players of a game run on the same thread and are only switched
+ * at a yield, never inside a critical section, so the game lock is
+ * never contended. Waiting between turns yields to the next coroutine
+ * (see backoff_wait()) instead of putting the thread to sleep.
+ */
+
+struct coro_run;
+
+// a slot for one game of a coroutine worker
+struct coro_game {
+    struct coro_run *run;
+    struct coro_sched *sched;
+    int game;                   // game being played
+    int running;                // players not yet done
+    struct game g;
+    struct player_thread args[4];
+};
+
+struct coro_run {
+    struct checkpoint *cp;
+    const uint64_t *seeds;      // as for run_batch()
+    int first;                  // first game of this run
+    int nextgame;               // next game to start
+    struct game_result *results;    // by game - first
+    bool *finished;                 // by game - first, accessed atomically
+};
+
+static void coro_player(void *arg);
+
+// start the next game of the batch in `cg`; false if none is left
+static bool
+coro_game_start(struct coro_game *cg)
 {
-    struct player_state *player = _arg;
-    threadname = player->name;
+    struct coro_run *run = cg->run;
+    int game = __atomic_fetch_add(&run->nextgame, 1, __ATOMIC_RELAXED);
+    if (game >= run->cp->ngames)
+        return false;
 
-    // this barrier allows threads to start at about the same time
-    pthread_barrier_wait(&readysetgo);
-    //pthread_mutex_lock(&lock);
-    while (player_can_take_turns_and_game_not_over(player, logfile)) {
-        // this player cannot make a turn right now, but the game is also
-        // not over.  Mark this player as having deadlocked - if 4 players
-        // deadlock (which occurs rarely, but does happen), then the
-        // game should stop
-        if (++deadlocked == 4) {
+    struct game_state deal;
+    batch_deal(run->cp, run->seeds, game, &deal);
+    cg->game = game;
+    cg->running = 4;
+    game_begin(&cg->g, &deal, cg->args);
+    for (int i = 0; i < 4; i++)
+        coro_spawn(cg->sched, coro_player, &cg->args[i]);
+    return true;
+}
+
+static void
+coro_player(void *_arg)
+{
+    struct player_thread *arg = _arg;
+    struct coro_game *cg = (struct coro_game *) ((char *) arg->game - offsetof(struct coro_game, g));
+    player_function(arg);
+
+    if (--cg->running == 0) {
+        struct coro_run *run = cg->run;
+        int i = cg->game - run->first;
+        game_end(&cg->g, cg->game, cg->args, &run->results[i], logfile);
+        __atomic_store_n(&run->finished[i], true, __ATOMIC_RELEASE);
+        coro_game_start(cg);
+    }
+}
+
+struct coro_worker {
+    pthread_t tid;
+    struct coro_run *run;
+    int ngames;                 // concurrent games
+    long switches;              // coroutine switches
+};
+
+static void *
+coro_worker(void *_arg)
+{
+    struct coro_worker *w = _arg;
+    struct coro_sched sched;
+    struct coro_game *games = aligned_alloc(64, sizeof(struct coro_game) * w->ngames);
+
+    coro_sched_init(&sched);
+    for (int i = 0; i < w->ngames; i++) {
+        games[i].run = w->run;
+        games[i].sched = &sched;
+        if (!coro_game_start(&games[i]))
             break;
-        }
-        pthread_mutex_lock(&lock);
-        deadlocked--;
-        pthread_mutex_unlock(&lock);
-        nanosleep(&ts, NULL);
     }
-    //pthread_mutex_unlock(&lock);
+    coro_sched_run(&sched);
+    w->switches = sched.switches;
+    free(games);
     return NULL;
 }
 
-// compute score for this player
+// play the rest of the batch with coroutine players on `nworkers` threads.
+// Returns the number of moves committed.
+static long
+run_coro(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint, int nworkers)
+{
+    int ngames = cp->ngames - cp->done;
+    struct coro_run run = {
+        .cp = cp,
+        .seeds = seeds,
+        .first = cp->done,
+        .nextgame = cp->done,
+        .results = malloc(sizeof(struct game_result) * ngames),
+        .finished = calloc(ngames, sizeof(bool)),
+    };
+
+    struct coro_worker workers[nworkers];
+    double start = now();
+    for (int i = 0; i < nworkers; i++) {
+        workers[i] = (struct coro_worker) { .run = &run, .ngames = env_int("CORO_GAMES", 64) };
+        pthread_create(&workers[i].tid, NULL, coro_worker, &workers[i]);
+    }
+    long moves = reduce_finished(cp, seeds, run.results, run.finished, checkpoint);
+    long switches = 0;
+    for (int i = 0; i < nworkers; i++) {
+        pthread_join(workers[i].tid, NULL);
+        switches += workers[i].switches;
+    }
+    double elapsed = now() - start;
+    fprintf(stderr, "%ld coroutine switches, %.0f/s\n", switches, switches / elapsed);
+
+    free(run.results);
+    free(run.finished);
+    return moves;
+}
+
+/*
+ * MODE=fork: WORKERS worker processes play the batch, so that a crash
+ * or a failed assertion, e.g. in validate_game(), costs only the game
+ * being played rather than the whole batch. Workers don't share a heap
+ * either, so they don't contend in the allocator.
+ *
+ * Each game has a slot in a region of shared memory. A worker claims a
+ * game by writing its place into the slot's owner with a single
+ * compare-and-swap, and marks the slot done once it has written the
+ * result there; the parent reduces the results in game order as for
+ * the other modes. When a worker dies, whatever game it owns that is
+ * not done was cut short, however far it got. The parent starts a new
+ * worker in its place, which plays that game again before it claims
+ * new ones. A game that kills FORK_RETRIES workers is skipped and
+ * reported.
+ *
+ * Each worker has its own copy of the TRACE statistics, which are lost
+ * when it exits.
+ */
+
+// workers a game may kill before it is skipped
+static const int FORK_RETRIES = 3;
+
+enum fork_game_state {
+    FORK_PENDING,       // not played to the end yet
+    FORK_DONE,          // result is valid
+    FORK_FAILED,        // skipped after killing FORK_RETRIES workers
+};
+
+// a game of the batch, in shared memory
+struct fork_game {
+    int state;                  // enum fork_game_state, accessed atomically
+    int owner;                  // place of the worker that claimed it + 1,
+                                // 0 if unclaimed, accessed atomically
+    int crashes;                // workers it killed, parent only
+    struct game_result result;  // once FORK_DONE
+};
+
+// a worker, in shared memory
+struct fork_worker {
+    pid_t pid;                  // 0 once it exited normally, parent only
+    int game;                   // game cut short by the previous worker in
+                                // this place, -1 if none; parent only
+    long games;                 // games played by workers in this place
+    int restarts;               // workers started in place of a dead one
+};
+
+// the shared region
+struct fork_run {
+    int nextgame;               // no game before this is unclaimed,
+                                // accessed atomically
+    int ngames;                 // games in the run
+    struct fork_worker *workers;
+    struct fork_game *games;    // by game - first
+};
+
+// claim the next unclaimed game for the worker in place `place`.
+// Returns it, or -1 if none is left.
 static int
-score_player(struct player_state *player)
+fork_claim(struct fork_run *run, int place, int first)
 {
-    int s = -2 * pile_size(&player->blitz);     // -2 for each card left in blitz pile
-    for (int i = 0; i < nextdutch; i++) {
-        for (int j = 0; j < dutch[i].top; j++)
-            if (get_back_color(dutch[i]._cards[j]) == player->bgcolor)
-                s++;        // +1 for each card in the dutch pile
+    for (int i = __atomic_load_n(&run->nextgame, __ATOMIC_RELAXED) - first; i < run->ngames; i++) {
+        int unclaimed = 0;
+        if (__atomic_compare_exchange_n(&run->games[i].owner, &unclaimed, place + 1,
+                                        false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&run->nextgame, first + i + 1, __ATOMIC_RELAXED);
+            return first + i;
+        }
     }
-    return s;
+    return -1;
+}
+
+// the game owned by the worker in place `place` that it did not finish,
+// or -1 if there is none
+static int
+fork_owned(struct fork_run *run, int place, int first)
+{
+    for (int i = 0; i < run->ngames; i++)
+        if (__atomic_load_n(&run->games[i].owner, __ATOMIC_ACQUIRE) == place + 1
+            && __atomic_load_n(&run->games[i].state, __ATOMIC_ACQUIRE) == FORK_PENDING)
+            return first + i;
+    return -1;
 }
 
-// compute score for all players
+// play games until none are left; runs in the worker process
 static void
-score_all_players(int scores[4], FILE *out)
+fork_worker_main(struct fork_run *run, struct fork_worker *w,
+                 struct checkpoint *cp, const uint64_t *seeds, int first)
 {
-    for (int i = 0; i < 4; i++) {
-        scores[i] = score_player(&players[i]);
-        if (out)
-            fprintf(out, "%d ", scores[i]);
+    int place = w - run->workers;
+    int game = w->game;
+    for (;;) {
+        if (game < 0 && (game = fork_claim(run, place, first)) < 0)
+            break;
+        struct fork_game *fg = &run->games[game - first];
+        struct game_state deal;
+        batch_deal(cp, seeds, game, &deal);
+        simulate_one_game(game, &deal, &fg->result, logfile);
+        // once it is done, the game is no longer ours to play again
+        __atomic_store_n(&fg->state, FORK_DONE, __ATOMIC_RELEASE);
+        w->games++;
+        game = -1;
     }
-    if (out)
-        fprintf(out, "\n");
+    exit(0);
 }
 
-// simulate a full game and write results to `scores`
+// start a worker process in place `w`
+static bool
+fork_spawn(struct fork_run *run, struct fork_worker *w,
+           struct checkpoint *cp, const uint64_t *seeds, int first)
+{
+    // otherwise the child would write out what is buffered again
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0)
+        fork_worker_main(run, w, cp, seeds, first);
+    w->pid = pid;
+    return true;
+}
+
+// a worker exited with `status`: if it died, give up on its game or
+// start a new worker to play it again
 static void
-simulate_one_game(int scores[4], FILE *out)
+fork_reap(struct fork_run *run, struct fork_worker *w, int status,
+          struct checkpoint *cp, const uint64_t *seeds, int first)
 {
-    for (int bgcolor = 0; bgcolor < 4; bgcolor++) {
-        players[bgcolor].name = colors[bgcolor];
-        players[bgcolor].bgcolor = bgcolor;
-        player_deal(&players[bgcolor]);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        w->pid = 0;
+        return;
+    }
+    int game = fork_owned(run, w - run->workers, first);
+    w->game = game;
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "worker %d died of %s", (int) w->pid, strsignal(WTERMSIG(status)));
+    else
+        fprintf(stderr, "worker %d exited with status %d", (int) w->pid, WEXITSTATUS(status));
+    if (game >= 0) {
+        struct fork_game *fg = &run->games[game - first];
+        fprintf(stderr, " playing game %d (seed %llu)", game,
+                (unsigned long long) batch_seed(cp, seeds, game));
+        if (++fg->crashes >= FORK_RETRIES) {
+            fprintf(stderr, ", skipping it");
+            w->game = -1;
+            __atomic_store_n(&fg->state, FORK_FAILED, __ATOMIC_RELEASE);
+        }
     }
+    fprintf(stderr, "\n");
+    w->restarts++;
+    if (!fork_spawn(run, w, cp, seeds, first))
+        w->pid = 0;
+}
 
-    pthread_t t[4];
-    pthread_barrier_init(&readysetgo, NULL, 4);
+// play the rest of the batch in `nworkers` worker processes.
+// Returns the number of moves committed.
+static long
+run_fork(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint, int nworkers)
+{
+    int first = cp->done;
+    int ngames = cp->ngames - first;
+    size_t size = sizeof(struct fork_run) + sizeof(struct fork_worker) * nworkers
+                + sizeof(struct fork_game) * ngames;
+    struct fork_run *run = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (run == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    // mmap'd memory is zero: all games are FORK_PENDING
+    run->nextgame = first;
+    run->ngames = ngames;
+    run->workers = (struct fork_worker *) (run + 1);
+    run->games = (struct fork_game *) (run->workers + nworkers);
 
-    uint8_t startorder[4] = {0, 1, 2, 3};
-    //fisher_yates(startorder, 4);
-    for (int i = 0; i < 4; i++) {
-        int rc = pthread_create(&t[i], NULL, player_function, players + startorder[i]);
-        if (rc != 0) {
-            errno = rc;
-            perror("pthread_create");
+    for (int i = 0; i < nworkers; i++) {
+        run->workers[i].game = -1;
+        fork_spawn(run, &run->workers[i], cp, seeds, first);
+    }
+
+    long moves = 0;
+    int failed = 0;
+    struct timespec poll = { 0, 100000 };
+    while (cp->done < cp->ngames) {
+        struct fork_game *fg = &run->games[cp->done - first];
+        int state = __atomic_load_n(&fg->state, __ATOMIC_ACQUIRE);
+        if (state == FORK_DONE) {
+            moves += fg->result.moves;
+            batch_add(cp, seeds, &fg->result, checkpoint);
+            continue;
+        }
+        if (state == FORK_FAILED) {
+            // counted as played, but not scored
+            struct game_result none = { .winner = -1, .end = GAME_FAILED };
+            batch_add(cp, seeds, &none, checkpoint);
+            failed++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid <= 0) {
+            if (pid < 0) {
+                fprintf(stderr, "all workers are gone after %d games\n", cp->done);
+                break;
+            }
+            nanosleep(&poll, NULL);
+            continue;
         }
+        for (int i = 0; i < nworkers; i++)
+            if (run->workers[i].pid == pid)
+                fork_reap(run, &run->workers[i], status, cp, seeds, first);
     }
+    while (wait(NULL) > 0)
+        continue;
 
-    for (int i = 0; i < 4; i++)
-    {
-        pthread_join(t[i], NULL);
+    fprintf(stderr, "%-6s %8s %9s\n", "worker", "games", "restarts");
+    for (int i = 0; i < nworkers; i++)
+        fprintf(stderr, "%-6d %8ld %9d\n", i, run->workers[i].games, run->workers[i].restarts);
+    if (failed)
+        fprintf(stderr, "%d games skipped\n", failed);
+    munmap(run, size);
+    return moves;
+}
+
+/*
+ * MODE=des: play the batch on this thread as a discrete-event
+ * simulation (des.c), in which seats play at modeled speeds rather than
+ * as fast as their threads are scheduled. DES_THINK sets the mean think
+ * time per seat in virtual ms, either one value for all or four comma
+ * separated, default 1; DES_DIST=exp|uniform|fixed how think times are
+ * distributed, default exp. The think times of each game are drawn from
+ * its own seed, so a batch is reproducible from SEED like the deals.
+ */
+static struct des_model des_model = { DES_EXP, { 1, 1, 1, 1 } };
+
+// play the rest of the batch as discrete-event simulations.
+// Returns the number of moves committed.
+static long
+run_des(struct checkpoint *cp, const uint64_t *seeds, const char *checkpoint)
+{
+    long moves = 0, events = 0;
+    double vtime = 0;
+    int played = cp->ngames - cp->done;
+    double start = now();
+    for (int i = cp->done; i < cp->ngames; i++) {
+        struct game_state deal;
+        struct game_result result;
+        struct game g;
+        struct player_thread args[4];
+        struct des_stats stats;
+        batch_deal(cp, seeds, i, &deal);
+        game_begin(&g, &deal, args);
+        game_play_des(&g, &des_model, rng_mix(batch_seed(cp, seeds, i)), &stats, logfile);
+        game_end(&g, i, args, &result, logfile);
+        moves += result.moves;
+        events += stats.events;
+        vtime += stats.time;
+        batch_add(cp, seeds, &result, checkpoint);
+    }
+    double elapsed = now() - start;
+    fprintf(stderr, "%ld events, %.0f/s, %.1f virtual ms per game\n",
+            events, events / elapsed, played ? vtime / played : 0.0);
+    return moves;
+}
+
+// read DES_THINK and DES_DIST into des_model; false if they are invalid
+static bool
+des_model_parse(void)
+{
+    char *think = getenv("DES_THINK");
+    if (think) {
+        char *end = think;
+        int n = 0;
+        for (; n < 4; n++) {
+            des_model.mean[n] = strtod(end, &end);
+            if (des_model.mean[n] < 0 || (*end != ',' && *end != '\0'))
+                goto bad;
+            if (*end++ == '\0')
+                break;
+        }
+        if (n == 0)
+            for (int i = 1; i < 4; i++)
+                des_model.mean[i] = des_model.mean[0];
+        else if (n != 3)
+            goto bad;
+    }
+    char *dist = getenv("DES_DIST");
+    if (dist && !des_dist_parse(dist, &des_model.dist)) {
+        fprintf(stderr, "DES_DIST must be exp, uniform or fixed\n");
+        return false;
+    }
+    return true;
+bad:
+    fprintf(stderr, "DES_THINK must be one or four think times\n");
+    return false;
+}
+
+/*
+ * MODE=bench: play fixed-seed workloads and print throughput as JSON,
+ * one result per line, so that builds can be compared with a diff or a
+ * script. `make bench` writes the results to bench_output.txt.
+ *
+ * Workloads, each with logging off and logging to /dev/null, and with
+ * 1, 2, 4, ... WORKERS pipeline workers:
+ *
+ *   short  N games dealt from seed, seed + 1, ...
+ *   stuck  N/100 games that end without a winner, which take longest
+ *          because players keep trying until all are stuck. Such deals
+ *          are rare, so finding them takes a while before the first run.
+ *
+ * These use the lock chosen with LOCK and the backoff chosen with
+ * BACKOFF. Then the short workload is played with every kind of game
+ * lock, and with every backoff policy, with 1, 2, 4, ... WORKERS
+ * workers, to compare their throughput, CPU use and how often each seat
+ * wins and scores.
+ */
+
+static double
+cpu_seconds(struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec + ru->ru_utime.tv_usec * 1e-6
+         + ru->ru_stime.tv_sec + ru->ru_stime.tv_usec * 1e-6;
+}
+
+// find `n` seeds from `seed` on whose games nobody wins when played
+// sequentially; threaded games from these deals usually get stuck too.
+// Returns how many were found.
+static int
+find_stuck_seeds(uint64_t seed, uint64_t *seeds, int n)
+{
+    int found = 0;
+    for (uint64_t s = seed; found < n && s < seed + 2000 * n; s++) {
+        struct game g;
+        game_reset(&g);
+        game_deal(&g.state, s);
+        game_play_sequential(&g, NULL);
+        if (!g.blitzed)
+            seeds[found++] = s;
     }
+    return found;
+}
+
+// play one workload and print its results
+static void
+bench_one(const char *workload, const uint64_t *seeds, int ngames, uint64_t seed,
+          FILE *log, int nworkers, enum game_lock_kind lock, enum backoff_kind backoff,
+          bool first)
+{
+    struct checkpoint cp = { .seed = seed, .ngames = ngames };
+    struct rusage before, after;
+
+    enum game_lock_kind savedlock = lock_kind;
+    enum backoff_kind savedbackoff = backoff_kind;
+    lock_kind = lock;
+    backoff_kind = backoff;
+    logfile = log;
+    getrusage(RUSAGE_SELF, &before);
+    double start = now();
+    long moves = run_pipeline(&cp, seeds, NULL, 1, nworkers);
+    double elapsed = now() - start;
+    getrusage(RUSAGE_SELF, &after);
+    logfile = NULL;
+    lock_kind = savedlock;
+    backoff_kind = savedbackoff;
+
+    printf("%s    {\"workload\": \"%s\", \"lock\": \"%s\", \"backoff\": \"%s\", \"logging\": %s, "
+           "\"workers\": %d, \"games\": %d, \"seconds\": %.3f, \"games_per_sec\": %.1f, "
+           "\"moves_per_sec\": %.0f, \"cpu_ms_per_game\": %.3f, "
+           "\"peak_rss_kb\": %ld, \"wins\": [%d, %d, %d, %d], "
+           "\"mean_score\": [%.2f, %.2f, %.2f, %.2f]}",
+           first ? "" : ",\n", workload, game_lock_kind_name(lock), backoff_kind_name(backoff),
+           log ? "true" : "false", nworkers, ngames, elapsed,
+           ngames / elapsed, moves / elapsed,
+           (cpu_seconds(&after) - cpu_seconds(&before)) * 1e3 / ngames,
+           after.ru_maxrss, cp.wins[0], cp.wins[1], cp.wins[2], cp.wins[3],
+           (double) cp.total_scores[0] / ngames, (double) cp.total_scores[1] / ngames,
+           (double) cp.total_scores[2] / ngames, (double) cp.total_scores[3] / ngames);
+    fflush(stdout);
+}
+
+static void
+run_bench(int ngames, uint64_t seed, int maxworkers)
+{
+    // the extra games would count as throughput
+    validate_snapshots = false;
+
+    int nstuck = ngames / 100 > 0 ? ngames / 100 : 1;
+    uint64_t stuck[nstuck];
+    nstuck = find_stuck_seeds(seed, stuck, nstuck);
 
-    pthread_barrier_destroy(&readysetgo);
+    struct {
+        const char *name;
+        const uint64_t *seeds;
+        int ngames;
+    } workloads[] = {
+        { "short", NULL, ngames },
+        { "stuck", stuck, nstuck },
+    };
+    int nworkloads = sizeof workloads / sizeof workloads[0];
 
-    if (!blitzed)
-        global_state_on_win(NULL, out);
+    FILE *devnull = fopen("/dev/null", "w");
+    int nresults = 0;
+    printf("{\n  \"seed\": %llu,\n  \"results\": [\n", (unsigned long long) seed);
+    for (int w = 0; w < nworkloads; w++) {
+        if (workloads[w].ngames == 0)
+            continue;
+        for (int log = 0; log < 2; log++)
+            for (int n = 1; n <= maxworkers; n *= 2)
+                bench_one(workloads[w].name, workloads[w].seeds, workloads[w].ngames,
+                          seed, log ? devnull : NULL, n, lock_kind, backoff_kind,
+                          nresults++ == 0);
+    }
+    for (int lock = 0; lock < GAME_LOCK_KINDS; lock++)
+        for (int n = 1; n <= maxworkers; n *= 2)
+            bench_one("short", NULL, ngames, seed, NULL, n, lock, backoff_kind, false);
+    for (int backoff = 0; backoff < BACKOFF_KINDS; backoff++)
+        for (int n = 1; n <= maxworkers; n *= 2)
+            bench_one("short", NULL, ngames, seed, NULL, n, lock_kind, backoff, false);
+    printf("\n  ]\n}\n");
+    fclose(devnull);
+}
 
-    score_all_players(scores, out);
+// play the rest of the batch as chosen with MODE
+static void
+run_mode(const char *mode, struct checkpoint *cp, const char *checkpoint, int nworkers)
+{
+    if (mode && !strcmp(mode, "pipeline"))
+        run_pipeline(cp, NULL, checkpoint, env_int("PRODUCERS", 1), nworkers);
+    else if (mode && !strcmp(mode, "steal"))
+        run_steal(cp, NULL, checkpoint, nworkers);
+    else if (mode && !strcmp(mode, "coro"))
+        run_coro(cp, NULL, checkpoint, nworkers);
+    else if (mode && !strcmp(mode, "fork"))
+        run_fork(cp, NULL, checkpoint, nworkers);
+    else if (mode && !strcmp(mode, "des"))
+        run_des(cp, NULL, checkpoint);
+    else
+        run_batch(cp, NULL, checkpoint);
+}
+
+/*
+ * Adaptive run length, enabled with CI=width: rather than all N games,
+ * play CI_BATCH games at a time (default 200) in the chosen mode, and
+ * stop as soon as the 95% confidence interval of every seat's mean
+ * score is at most `width` points wide. N is then the most games that
+ * are played. The means and variances are updated as each game is
+ * reduced, see batch_add().
+ */
+static void
+run_adaptive(const char *mode, struct checkpoint *cp, int nworkers, double width, int batch)
+{
+    int maxgames = cp->ngames;
+    bool converged = false;
+    while (!converged && cp->done < maxgames) {
+        cp->ngames = maxgames - cp->done > batch ? cp->done + batch : maxgames;
+        run_mode(mode, cp, NULL, nworkers);
+        converged = true;
+        for (int i = 0; i < 4; i++)
+            if (2 * running_halfwidth(&seatscores[i]) > width)
+                converged = false;
+    }
+    cp->ngames = maxgames;
+
+    fprintf(stderr, "%s after %d games; mean score, 95%% CI:",
+            converged ? "converged" : "not converged", cp->done);
+    for (int i = 0; i < 4; i++)
+        fprintf(stderr, " %s %.3f +- %.3f", colors[i],
+                seatscores[i].mean, running_halfwidth(&seatscores[i]));
+    fprintf(stderr, "\n");
 }
 
 int
@@ -561,19 +1498,90 @@ main(int ac, char *av[])
     int N_GAMES = ac > 1 ? atoi(av[1]) : 1000;
     char *output = getenv("OUTPUT");
     logfile = output && !strcmp(output, "stdout") ? stdout : NULL;
+    char *validate = getenv("VALIDATE");
+    if (validate) {
+        validate_every = !strcmp(validate, "all") ? 1 :
+                         !strcmp(validate, "none") ? 0 : atoi(validate);
+        validate_snapshots = validate_every > 0;
+    }
 
-    srand(time(NULL));
+    char *seed = getenv("SEED");
+    char *checkpoint = getenv("CHECKPOINT");
 
-    int total_scores[4] = { 0 };
-    for (int i = 0; i < N_GAMES; i++) {
-        int scores[4];
-        reset_simulation();
-        simulate_one_game(scores, logfile);
-        for (int j = 0; j < 4; j++)
-            total_scores[j] += scores[j];
+    struct checkpoint cp = { .ngames = N_GAMES };
+    cp.seed = seed ? strtoull(seed, NULL, 0) : time(NULL);
+    if (checkpoint && checkpoint_load(checkpoint, &cp)) {
+        fprintf(stderr, "resuming batch of %d games with seed %llu after game %d\n",
+                cp.ngames, (unsigned long long) cp.seed, cp.done);
+        N_GAMES = cp.ngames;
     }
+
+    char *lock = getenv("LOCK");
+    if (lock && !game_lock_kind_parse(lock, &lock_kind)) {
+        fprintf(stderr, "unknown LOCK=%s, use pthread, fair, ticket, barge or spin\n", lock);
+        return 1;
+    }
+
+    char *backoff = getenv("BACKOFF");
+    if (backoff && !backoff_kind_parse(backoff, &backoff_kind)) {
+        fprintf(stderr, "unknown BACKOFF=%s, use nanosleep, pause, exp, yield or random\n", backoff);
+        return 1;
+    }
+
+    char *commit = getenv("COMMIT");
+    split_commit = commit && !strcmp(commit, "split");
+    combine_commits = commit && !strcmp(commit, "combine");
+    char *trace = getenv("TRACE");
+    trace_moves = trace && atoi(trace);
+    if (trace_moves)
+        for (int i = 0; i < 4; i++)
+            move_stats_init(&seatstats[i]);
+    char *perf = getenv("PERF");
+    perf_counters = perf && atoi(perf);
+
+    char *mode = getenv("MODE");
+    if (mode && !strcmp(mode, "solve")) {
+        solver_run(N_GAMES, cp.seed, stdout);
+        return 0;
+    }
+
+    int nworkers = env_int("WORKERS", sysconf(_SC_NPROCESSORS_ONLN));
+    if (mode && !strcmp(mode, "bench")) {
+        run_bench(N_GAMES, seed ? cp.seed : 1, nworkers);
+        return 0;
+    }
+
+    if (mode && !strcmp(mode, "des") && !des_model_parse())
+        return 1;
+
+    char *resultspath = getenv("RESULTS");
+    if (resultspath && (resultsfile = results_open(resultspath)) == NULL)
+        return 1;
+
+    char *ci = getenv("CI");
+    if (ci && atof(ci) > 0) {
+        // the running means and variances are not checkpointed
+        if (checkpoint) {
+            fprintf(stderr, "CI cannot be combined with CHECKPOINT\n");
+            return 1;
+        }
+        run_adaptive(mode, &cp, nworkers, atof(ci), env_int("CI_BATCH", 200));
+    } else {
+        run_mode(mode, &cp, checkpoint, nworkers);
+    }
+
+    if (resultsfile && !results_close(resultsfile))
+        return 1;
+
     for (int i = 0; i < 4; i++) {
-        fprintf(stdout, "%d ", total_scores[i]);
+        fprintf(stdout, "%d ", cp.total_scores[i]);
     }
     fprintf(stdout, "\n");
+    if (trace_moves)
+        move_stats_report(stderr);
+    if (perf_counters)
+        perf_report(stderr);
+    if (combine_commits)
+        fprintf(stderr, "%ld turns combined in %ld passes, %.2f per pass\n",
+                combineops, combinepasses, combinepasses ? (double) combineops / combinepasses : 0.0);
 }
@@ -1,96 +1,754 @@
 #include "fairlock.h"
 #include <signal.h>
 #include <pthread.h> 
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// values of fairwaiter.state
+enum {
+    WAITER_WAITING,     // queued on the fair_cond
+    WAITER_MORPHED,     // queued for the fair lock (FAIR_LOCK_QUEUE), or
+                        // signaled and holding a reserved ticket
+    WAITER_GRANTED,     // owns the fair lock
+    WAITER_CANCELLED,   // timed out before being signaled
+    WAITER_WOKEN,       // FAIR_LOCK_BARGE: queued for the lock and woken
+                        // to try to take it
+};
+
+// create a new fair lock of the given kind
+struct fair_lock * fair_lock_new_kind(enum fair_lock_kind kind) {
+    if (kind == FAIR_LOCK_BARGE) {
+        char *maxwait = getenv("FAIRLOCK_MAXWAIT");
+        return fair_lock_new_barge(maxwait ? atoi(maxwait) : FAIR_LOCK_MAXWAIT_US);
+    }
 
-// create a new fair lock
-struct fair_lock * fair_lock_new() {
     struct fair_lock* fairLock = malloc(sizeof(struct fair_lock));
     //init
-    fairLock->isLocked = false;
-    pthread_mutex_init(&fairLock->lock, NULL);
-    list_init(&fairLock->listofThreads);
+    fairLock->kind = kind;
+    if (kind == FAIR_LOCK_TICKET) {
+        fairLock->next = 0;
+        fairLock->owner = 0;
+        list_init(&fairLock->morphed);
+        for (int i = 0; i < FAIR_LOCK_SLOTS; i++)
+            fairLock->slot[i] = 0;
+    }
+    else {
+        fairLock->count = 0;
+        mpsc_init(&fairLock->waiters);
+    }
     return fairLock;
 }
 
+// create a new barging fair lock
+struct fair_lock * fair_lock_new_barge(unsigned maxwait_us) {
+    struct fair_lock* fairLock = malloc(sizeof(struct fair_lock));
+    fairLock->kind = FAIR_LOCK_BARGE;
+    fairLock->held = 0;
+    fairLock->nwaiters = 0;
+    fairLock->maxwait = maxwait_us * 1000ull;
+    pthread_mutex_init(&fairLock->qlock, NULL);
+    list_init(&fairLock->queue);
+    return fairLock;
+}
+
+// free a fair lock that nobody holds or waits for
+void fair_lock_free(struct fair_lock *lock) {
+    if (lock->kind == FAIR_LOCK_BARGE)
+        pthread_mutex_destroy(&lock->qlock);
+    free(lock);
+}
+
+// create a new fair lock
+struct fair_lock * fair_lock_new() {
+    char *kind = getenv("FAIRLOCK");
+    if (kind && !strcmp(kind, "ticket"))
+        return fair_lock_new_kind(FAIR_LOCK_TICKET);
+    if (kind && !strcmp(kind, "barge"))
+        return fair_lock_new_kind(FAIR_LOCK_BARGE);
+    return fair_lock_new_kind(FAIR_LOCK_QUEUE);
+}
+
+/*
+ * FAIR_LOCK_QUEUE: a count of threads holding or waiting for the lock,
+ * and a lock-free queue of waiters.
+ *
+ * fair_lock() takes the lock if it raises `count` from 0. Otherwise it
+ * pushes a waiter onto `waiters` without taking any mutex and sleeps on
+ * the waiter's own cond var. fair_unlock() releases the lock if it
+ * lowers `count` to 0; otherwise there is a waiter, and the holder,
+ * the only consumer of `waiters`, pops it and hands the lock to it.
+ * A waiter may have raised `count` but not yet finished its push; the
+ * holder then yields until the waiter shows up.
+ */
+
+static void
+waiter_init(struct fairwaiter *waiter, unsigned state)
+{
+    pthread_mutex_init(&waiter->mutex, NULL);
+    pthread_cond_init(&waiter->condVar, NULL);
+    waiter->state = state;
+}
+
+static void
+waiter_destroy(struct fairwaiter *waiter)
+{
+    pthread_cond_destroy(&waiter->condVar);
+    pthread_mutex_destroy(&waiter->mutex);
+}
+
+// hand the fair lock to `waiter`. Its state is changed under its own
+// mutex, so it cannot return and release its stack frame before we
+// are done with it.
+static void
+waiter_grant(struct fairwaiter *waiter)
+{
+    pthread_mutex_lock(&waiter->mutex);
+    waiter->state = WAITER_GRANTED;
+    pthread_cond_signal(&waiter->condVar);
+    pthread_mutex_unlock(&waiter->mutex);
+}
+
+// line up for the fair lock. The caller has already counted itself.
+static void
+queue_enqueue(struct fair_lock *lock, struct fairwaiter *waiter)
+{
+    mpsc_push(&lock->waiters, &waiter->qelem);
+}
+
 // lock this fair lock
-void fair_lock(struct fair_lock *lock) {
-    pthread_mutex_lock(&lock->lock);
-    if (!lock->isLocked) {
-        lock->isLocked = true;
+static void
+queue_lock(struct fair_lock *lock)
+{
+    if (__atomic_fetch_add(&lock->count, 1, __ATOMIC_SEQ_CST) == 0)
+        return;
+
+    struct fairwaiter waiter;
+    waiter_init(&waiter, WAITER_MORPHED);
+    queue_enqueue(lock, &waiter);
+
+    //move the thread to the BLOCKED state
+    pthread_mutex_lock(&waiter.mutex);
+    while (waiter.state != WAITER_GRANTED)
+        pthread_cond_wait(&waiter.condVar, &waiter.mutex);
+    pthread_mutex_unlock(&waiter.mutex);
+    waiter_destroy(&waiter);
+}
+
+// unlock this fair lock
+static void
+queue_unlock(struct fair_lock *lock)
+{
+    if (__atomic_fetch_sub(&lock->count, 1, __ATOMIC_SEQ_CST) == 1)
+        return;
+
+    // somebody is waiting, or about to be: hand the lock to the oldest
+    struct mpsc_elem *e;
+    while ((e = mpsc_pop(&lock->waiters)) == NULL)
+        sched_yield();
+    waiter_grant(mpsc_entry(e, struct fairwaiter, qelem));
+}
+
+// wait on this fair condition variable until signaled or until
+// `abstime` (CLOCK_REALTIME) has passed; NULL waits forever.
+// Returns 0 or ETIMEDOUT; either way the fair lock is held again.
+static int
+queue_cond_wait_until(struct fair_cond *cond, const struct timespec *abstime)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+    struct fairwaiter waiter;
+
+    // we hold the fair lock, which protects the condition's queue
+    waiter_init(&waiter, WAITER_WAITING);
+    waiter.onCond = true;
+    list_push_back(&cond->listofThreads, &waiter.elem);
+    queue_unlock(fairlock);
+
+    //moves into the BLOCKED state. A signal does not wake us up; it
+    //moves us onto the fair lock's queue, and we are woken only once
+    //the lock has been handed to us.
+    pthread_mutex_lock(&waiter.mutex);
+    while (waiter.state != WAITER_GRANTED) {
+        if (abstime == NULL || waiter.state != WAITER_WAITING) {
+            pthread_cond_wait(&waiter.condVar, &waiter.mutex);
+        }
+        else if (pthread_cond_timedwait(&waiter.condVar, &waiter.mutex, abstime) == ETIMEDOUT
+                 && waiter.state == WAITER_WAITING) {
+            // nobody signaled us: line up for the fair lock like any
+            // other thread, then leave the condition's queue unless a
+            // signaler already removed us
+            waiter.state = WAITER_CANCELLED;
+            pthread_mutex_unlock(&waiter.mutex);
+            queue_lock(fairlock);
+            if (waiter.onCond)
+                list_remove(&waiter.elem);
+            waiter_destroy(&waiter);
+            return ETIMEDOUT;
+        }
     }
-    else {
-        // add to the list 
-        struct fairwaiter* waiter = malloc(sizeof(struct fairwaiter));
-        pthread_cond_init(&waiter->condVar, NULL);
-        list_push_back(&lock->listofThreads, &waiter->elem);
-        
-        //move the thread to the BLOCKED state
-        pthread_cond_wait(&waiter->condVar, &lock->lock);
-        free(waiter);
+    pthread_mutex_unlock(&waiter.mutex);
+    waiter_destroy(&waiter);
+    return 0;
+}
+
+// move up to `n` waiters from the condition's queue to the tail of the
+// fair lock's queue, preserving their order (wait morphing).
+// Must be called while holding the fair lock.
+static void
+queue_cond_requeue(struct fair_cond *cond, int n)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+
+    while (n > 0 && !list_empty(&cond->listofThreads)) {
+        struct list_elem* eleml = list_pop_front(&cond->listofThreads);
+        struct fairwaiter* waiter = list_entry(eleml, struct fairwaiter, elem);
+        waiter->onCond = false;
+
+        pthread_mutex_lock(&waiter->mutex);
+        bool morph = waiter->state == WAITER_WAITING;
+        if (morph)
+            waiter->state = WAITER_MORPHED;
+        pthread_mutex_unlock(&waiter->mutex);
+        if (!morph)
+            continue;   // timed out, it is queueing for the lock by itself
+
+        // we hold the lock, so the count cannot drop to 0 before the
+        // waiter is on the queue
+        __atomic_fetch_add(&fairlock->count, 1, __ATOMIC_SEQ_CST);
+        queue_enqueue(fairlock, waiter);
+        n--;
     }
-    pthread_mutex_unlock(&lock->lock);
 }
 
-// unlock this fair lock
-void fair_unlock(struct fair_lock *lock) {
-    pthread_mutex_lock(&lock->lock);
-    if (!list_empty(&lock->listofThreads)) {
-        struct list_elem* eleml = list_pop_front(&lock->listofThreads);
+/*
+ * FAIR_LOCK_TICKET: a ticket lock whose waiters sleep on futex words.
+ *
+ * fair_lock() takes a ticket with a single atomic increment and owns the
+ * lock once `owner` reaches that ticket. Waiters park on the futex word
+ * slot[ticket % FAIR_LOCK_SLOTS]; fair_unlock() advances `owner` and
+ * wakes only that slot, i.e. the next ticket holder (plus, rarely, a
+ * waiter FAIR_LOCK_SLOTS tickets further back, which parks again).
+ *
+ * Condition waiters sleep on their own waiter->state word. A signal
+ * reserves a ticket for the waiter and puts it on `morphed`; when
+ * `owner` reaches that ticket, fair_unlock() hands the lock to the
+ * waiter directly.
+ */
+
+// spin this many times before parking on the futex
+static const int TICKET_SPINS = 100;
+
+static int
+futex(unsigned *uaddr, int op, unsigned val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, uaddr, op, val, timeout, NULL, FUTEX_BITSET_MATCH_ANY);
+}
+
+// sleep while *uaddr == val, optionally until `abstime` (CLOCK_REALTIME).
+// Returns ETIMEDOUT if the deadline passed, 0 otherwise.
+static int
+futex_wait(unsigned *uaddr, unsigned val, const struct timespec *abstime)
+{
+    int op = FUTEX_PRIVATE_FLAG;
+    op |= abstime ? FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME : FUTEX_WAIT;
+    if (futex(uaddr, op, val, abstime) == -1 && errno == ETIMEDOUT)
+        return ETIMEDOUT;
+    return 0;
+}
+
+static void
+futex_wake(unsigned *uaddr, int n)
+{
+    futex(uaddr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, n, NULL);
+}
+
+static void
+ticket_lock(struct fair_lock *lock)
+{
+    unsigned ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < TICKET_SPINS; i++)
+        if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) == ticket)
+            return;
+
+    unsigned *slot = &lock->slot[ticket % FAIR_LOCK_SLOTS];
+    for (;;) {
+        // read the slot before checking owner, so that an unlock in
+        // between changes the slot and the futex wait returns at once
+        unsigned seq = __atomic_load_n(slot, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&lock->owner, __ATOMIC_SEQ_CST) == ticket)
+            return;
+        futex_wait(slot, seq, NULL);
+    }
+}
+
+static void
+ticket_unlock(struct fair_lock *lock)
+{
+    unsigned next = lock->owner + 1;
+
+    // the next ticket may belong to a signaled condition waiter. Check
+    // before advancing owner: after that the list belongs to the next holder.
+    if (!list_empty(&lock->morphed)) {
+        struct fairwaiter* waiter = list_entry(list_front(&lock->morphed), struct fairwaiter, elem);
+        if (waiter->ticket == next) {
+            list_pop_front(&lock->morphed);
+            __atomic_store_n(&lock->owner, next, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&waiter->state, WAITER_GRANTED, __ATOMIC_SEQ_CST);
+            futex_wake(&waiter->state, 1);
+            return;
+        }
+    }
+
+    __atomic_store_n(&lock->owner, next, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lock->next, __ATOMIC_SEQ_CST) != next) {
+        unsigned *slot = &lock->slot[next % FAIR_LOCK_SLOTS];
+        __atomic_fetch_add(slot, 1, __ATOMIC_SEQ_CST);
+        futex_wake(slot, INT_MAX);
+    }
+}
+
+static int
+ticket_cond_wait_until(struct fair_cond *cond, const struct timespec *abstime)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+    struct fairwaiter waiter;
+    int rc = 0;
+
+    // we hold the fair lock, which protects the condition's queue
+    waiter.state = WAITER_WAITING;
+    waiter.onCond = true;
+    list_push_back(&cond->listofThreads, &waiter.elem);
+    ticket_unlock(fairlock);
+
+    for (;;) {
+        unsigned state = __atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE);
+        if (state == WAITER_GRANTED)
+            break;
+        if (state == WAITER_WAITING && abstime) {
+            if (futex_wait(&waiter.state, state, abstime) == ETIMEDOUT) {
+                unsigned expected = WAITER_WAITING;
+                if (__atomic_compare_exchange_n(&waiter.state, &expected, WAITER_CANCELLED,
+                                                false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                    // nobody signaled us: queue up for the lock, then
+                    // leave the condition's queue unless a signaler
+                    // already removed us
+                    ticket_lock(fairlock);
+                    if (waiter.onCond)
+                        list_remove(&waiter.elem);
+                    rc = ETIMEDOUT;
+                    break;
+                }
+            }
+        } else {
+            futex_wait(&waiter.state, state, NULL);
+        }
+    }
+    return rc;
+}
+
+// move up to `n` waiters to the fair lock by reserving tickets for them.
+// Must be called while holding the fair lock.
+static void
+ticket_cond_requeue(struct fair_cond *cond, int n)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+
+    while (n > 0 && !list_empty(&cond->listofThreads)) {
+        struct list_elem* eleml = list_pop_front(&cond->listofThreads);
         struct fairwaiter* waiter = list_entry(eleml, struct fairwaiter, elem);
-        pthread_cond_signal(&waiter->condVar);
+        waiter->onCond = false;
+
+        unsigned expected = WAITER_WAITING;
+        if (!__atomic_compare_exchange_n(&waiter->state, &expected, WAITER_MORPHED,
+                                         false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            continue;   // timed out, it is queueing for the lock by itself
+        waiter->ticket = __atomic_fetch_add(&fairlock->next, 1, __ATOMIC_SEQ_CST);
+        list_push_back(&fairlock->morphed, &waiter->elem);
+        n--;
     }
-    else {
-        lock->isLocked = false;
+}
+
+/*
+ * FAIR_LOCK_BARGE: a lock that running threads may barge into, with a
+ * strict handoff once the oldest waiter has waited longer than `maxwait`.
+ *
+ * A handoff keeps the lock idle until the thread it was handed to has
+ * been scheduled, and every other thread that wants it queues up
+ * behind, so under contention a strict FIFO lock forms a convoy. Here
+ * fair_lock() takes the lock whenever it finds `held` clear, even if
+ * others are queued. Threads that find it held queue up on `queue`,
+ * stamped with the time they arrived, and sleep on their own state
+ * word. fair_unlock() clears `held` and wakes the oldest waiter, which
+ * tries to take the lock like anybody else and goes back to sleep if it
+ * was beaten to it. Once the oldest waiter has waited longer than
+ * `maxwait`, fair_unlock() hands the lock to it without clearing `held`,
+ * as FAIR_LOCK_QUEUE always does, so no waiter waits much longer than
+ * `maxwait` plus one critical section per waiter ahead of it.
+ *
+ * `nwaiters` lets fair_unlock() skip `qlock` while nobody is queued: a
+ * thread counts itself before its last try to take the lock, and
+ * fair_unlock() checks the count after clearing `held`, so one of them
+ * sees the other.
+ */
+
+static uint64_t
+barge_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool
+barge_try(struct fair_lock *lock)
+{
+    unsigned expected = 0;
+    return __atomic_compare_exchange_n(&lock->held, &expected, 1,
+                                       false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// put `waiter` at the back of the queue. Must be called with qlock held.
+static void
+barge_enqueue(struct fair_lock *lock, struct fairwaiter *waiter)
+{
+    waiter->since = barge_now();
+    list_push_back(&lock->queue, &waiter->elem);
+}
+
+// wake the oldest waiter to try to take the lock.
+// Must be called with qlock held.
+static void
+barge_wake(struct fair_lock *lock)
+{
+    if (list_empty(&lock->queue))
+        return;
+    struct fairwaiter* waiter = list_entry(list_front(&lock->queue), struct fairwaiter, elem);
+    if (waiter->state == WAITER_MORPHED) {
+        __atomic_store_n(&waiter->state, WAITER_WOKEN, __ATOMIC_SEQ_CST);
+        futex_wake(&waiter->state, 1);
     }
-    pthread_mutex_unlock(&lock->lock);
 }
 
-// wait on this fair condition variable
-void fair_cond_wait(struct fair_cond *cond) {
+// sleep until `waiter`, which is queued, has been handed the lock or
+// has taken it after being woken
+static void
+barge_wait(struct fair_lock *lock, struct fairwaiter *waiter)
+{
+    for (;;) {
+        futex_wait(&waiter->state, WAITER_MORPHED, NULL);
+        pthread_mutex_lock(&lock->qlock);
+        if (waiter->state == WAITER_GRANTED)
+            break;      // handed off, and already off the queue
+        if (waiter->state == WAITER_WOKEN) {
+            if (barge_try(lock)) {
+                list_remove(&waiter->elem);
+                __atomic_fetch_sub(&lock->nwaiters, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            __atomic_store_n(&waiter->state, WAITER_MORPHED, __ATOMIC_SEQ_CST);
+        }
+        pthread_mutex_unlock(&lock->qlock);
+    }
+    pthread_mutex_unlock(&lock->qlock);
+}
 
-    pthread_mutex_lock(&cond->lock);
+static void
+barge_lock(struct fair_lock *lock)
+{
+    if (barge_try(lock))
+        return;
 
-    //adds itself to a queue of waiters
-    struct fairwaiter* waiter = malloc(sizeof(struct fairwaiter));
-    pthread_cond_init(&waiter->condVar, NULL);
+    struct fairwaiter waiter;
+    pthread_mutex_lock(&lock->qlock);
+    __atomic_fetch_add(&lock->nwaiters, 1, __ATOMIC_SEQ_CST);
+    if (barge_try(lock)) {
+        __atomic_fetch_sub(&lock->nwaiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&lock->qlock);
+        return;
+    }
+    waiter.state = WAITER_MORPHED;
+    barge_enqueue(lock, &waiter);
+    pthread_mutex_unlock(&lock->qlock);
+    barge_wait(lock, &waiter);
+}
 
-    list_push_back(&cond->listofThreads, &waiter->elem);
+static void
+barge_unlock(struct fair_lock *lock)
+{
+    if (__atomic_load_n(&lock->nwaiters, __ATOMIC_SEQ_CST) == 0) {
+        __atomic_store_n(&lock->held, 0, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&lock->nwaiters, __ATOMIC_SEQ_CST) == 0)
+            return;
+        // somebody queued up after all; it may already be asleep
+        pthread_mutex_lock(&lock->qlock);
+        barge_wake(lock);
+        pthread_mutex_unlock(&lock->qlock);
+        return;
+    }
 
-    //unlocks the fair lock
-    fair_unlock(cond->fairlock);
+    pthread_mutex_lock(&lock->qlock);
+    if (!list_empty(&lock->queue)) {
+        struct fairwaiter* waiter = list_entry(list_front(&lock->queue), struct fairwaiter, elem);
+        if (barge_now() - waiter->since > lock->maxwait) {
+            // waited long enough: hand it the lock, barging or not.
+            // It cannot return before we release qlock.
+            list_pop_front(&lock->queue);
+            __atomic_fetch_sub(&lock->nwaiters, 1, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&waiter->state, WAITER_GRANTED, __ATOMIC_SEQ_CST);
+            futex_wake(&waiter->state, 1);
+            pthread_mutex_unlock(&lock->qlock);
+            return;
+        }
+    }
+    __atomic_store_n(&lock->held, 0, __ATOMIC_SEQ_CST);
+    barge_wake(lock);
+    pthread_mutex_unlock(&lock->qlock);
+}
 
-    //moves into the BLOCKED state
-    pthread_cond_wait(&waiter->condVar, &cond->lock);
+static int
+barge_cond_wait_until(struct fair_cond *cond, const struct timespec *abstime)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+    struct fairwaiter waiter;
+    int rc = 0;
 
-    pthread_mutex_unlock(&cond->lock);
+    // we hold the fair lock, which protects the condition's queue
+    waiter.state = WAITER_WAITING;
+    waiter.onCond = true;
+    list_push_back(&cond->listofThreads, &waiter.elem);
+    barge_unlock(fairlock);
 
-    free(waiter);
+    // a signal queues us for the lock without waking us; we wake up
+    // once we are handed the lock or woken to try to take it
+    for (;;) {
+        unsigned state = __atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE);
+        if (state != WAITER_WAITING) {
+            barge_wait(fairlock, &waiter);
+            break;
+        }
+        if (abstime == NULL) {
+            futex_wait(&waiter.state, state, NULL);
+        }
+        else if (futex_wait(&waiter.state, state, abstime) == ETIMEDOUT) {
+            unsigned expected = WAITER_WAITING;
+            if (__atomic_compare_exchange_n(&waiter.state, &expected, WAITER_CANCELLED,
+                                            false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                // nobody signaled us: queue up for the lock, then
+                // leave the condition's queue unless a signaler
+                // already removed us
+                barge_lock(fairlock);
+                if (waiter.onCond)
+                    list_remove(&waiter.elem);
+                rc = ETIMEDOUT;
+                break;
+            }
+        }
+    }
+    return rc;
+}
+
+// move up to `n` waiters from the condition's queue to the back of the
+// fair lock's queue, preserving their order (wait morphing).
+// Must be called while holding the fair lock.
+static void
+barge_cond_requeue(struct fair_cond *cond, int n)
+{
+    struct fair_lock *fairlock = cond->fairlock;
+
+    pthread_mutex_lock(&fairlock->qlock);
+    while (n > 0 && !list_empty(&cond->listofThreads)) {
+        struct list_elem* eleml = list_pop_front(&cond->listofThreads);
+        struct fairwaiter* waiter = list_entry(eleml, struct fairwaiter, elem);
+        waiter->onCond = false;
 
-    //locks the fair lock again
-    fair_lock(cond->fairlock);
+        unsigned expected = WAITER_WAITING;
+        if (!__atomic_compare_exchange_n(&waiter->state, &expected, WAITER_MORPHED,
+                                         false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            continue;   // timed out, it is queueing for the lock by itself
+        // we hold the lock, so our unlock will see the count
+        __atomic_fetch_add(&fairlock->nwaiters, 1, __ATOMIC_SEQ_CST);
+        barge_enqueue(fairlock, waiter);
+        n--;
+    }
+    pthread_mutex_unlock(&fairlock->qlock);
+}
+
+// lock this fair lock
+void fair_lock(struct fair_lock *lock) {
+    switch (lock->kind) {
+    case FAIR_LOCK_TICKET:
+        ticket_lock(lock);
+        break;
+    case FAIR_LOCK_BARGE:
+        barge_lock(lock);
+        break;
+    default:
+        queue_lock(lock);
+    }
+}
+
+// unlock this fair lock
+void fair_unlock(struct fair_lock *lock) {
+    switch (lock->kind) {
+    case FAIR_LOCK_TICKET:
+        ticket_unlock(lock);
+        break;
+    case FAIR_LOCK_BARGE:
+        barge_unlock(lock);
+        break;
+    default:
+        queue_unlock(lock);
+    }
+}
+
+// wait on this fair condition variable
+void fair_cond_wait(struct fair_cond *cond) {
+    fair_cond_timedwait(cond, NULL);
+}
+
+// wait on this fair condition variable, but no longer than `abstime`
+int fair_cond_timedwait(struct fair_cond *cond, const struct timespec *abstime) {
+    switch (cond->fairlock->kind) {
+    case FAIR_LOCK_TICKET:
+        return ticket_cond_wait_until(cond, abstime);
+    case FAIR_LOCK_BARGE:
+        return barge_cond_wait_until(cond, abstime);
+    default:
+        return queue_cond_wait_until(cond, abstime);
+    }
+}
+
+// move up to `n` waiters of the condition to the fair lock
+static void
+fair_cond_requeue(struct fair_cond *cond, int n)
+{
+    switch (cond->fairlock->kind) {
+    case FAIR_LOCK_TICKET:
+        ticket_cond_requeue(cond, n);
+        break;
+    case FAIR_LOCK_BARGE:
+        barge_cond_requeue(cond, n);
+        break;
+    default:
+        queue_cond_requeue(cond, n);
+    }
+}
+
+// wake up one thread waiting on that fair condition variable
+void fair_cond_signal(struct fair_cond *cond) {
+    fair_cond_requeue(cond, 1);
 }
 
 // wake up all threads waiting on that fair condition variable
 void fair_cond_broadcast(struct fair_cond *cond) {
-    pthread_mutex_lock(&cond->lock);
-
-    if (!list_empty(&cond->listofThreads)) {
-        while (!list_empty(&cond->listofThreads))
-        {
-            struct list_elem* eleml = list_pop_front(&cond->listofThreads);
-            struct fairwaiter* waiter = list_entry(eleml, struct fairwaiter, elem);
-            pthread_cond_signal(&waiter->condVar);
-        }
-    }
-    pthread_mutex_unlock(&cond->lock);
+    fair_cond_requeue(cond, INT_MAX);
 }
 
 // create a fair condition variable tied to the given fair lock
 struct fair_cond *fair_cond_new(struct fair_lock *lock) {
-    struct fair_cond* fairCond = malloc(sizeof(struct fair_lock));
+    struct fair_cond* fairCond = malloc(sizeof(struct fair_cond));
     //init
     list_init(&fairCond->listofThreads);
-    pthread_mutex_init(&fairCond->lock, NULL);
     fairCond->fairlock = lock;
     return fairCond;
-}
\ No newline at end of file
+}
+
+// create a new fair reader-writer lock
+struct fair_rwlock *fair_rwlock_new() {
+    struct fair_rwlock* rwlock = malloc(sizeof(struct fair_rwlock));
+    //init
+    rwlock->readers = 0;
+    rwlock->writer = false;
+    pthread_mutex_init(&rwlock->lock, NULL);
+    list_init(&rwlock->listofThreads);
+    return rwlock;
+}
+
+// add the calling thread to the queue and block until it has been
+// handed the lock. Must be called with rwlock->lock held.
+static void
+fair_rwlock_wait(struct fair_rwlock *rwlock, bool isWriter)
+{
+    struct fairwaiter* waiter = malloc(sizeof(struct fairwaiter));
+    pthread_cond_init(&waiter->condVar, NULL);
+    waiter->isWriter = isWriter;
+    waiter->granted = false;
+    list_push_back(&rwlock->listofThreads, &waiter->elem);
+
+    //move the thread to the BLOCKED state
+    while (!waiter->granted)
+        pthread_cond_wait(&waiter->condVar, &rwlock->lock);
+
+    pthread_cond_destroy(&waiter->condVar);
+    free(waiter);
+}
+
+// hand the lock to the front of the queue: either a single writer, or
+// every reader up to the next queued writer.
+// Must be called with rwlock->lock held and the lock not in use.
+static void
+fair_rwlock_grant(struct fair_rwlock *rwlock)
+{
+    while (!list_empty(&rwlock->listofThreads)) {
+        struct list_elem* eleml = list_front(&rwlock->listofThreads);
+        struct fairwaiter* waiter = list_entry(eleml, struct fairwaiter, elem);
+        if (waiter->isWriter) {
+            if (rwlock->readers > 0)
+                break;
+            rwlock->writer = true;
+        } else {
+            rwlock->readers++;
+        }
+        list_pop_front(&rwlock->listofThreads);
+        waiter->granted = true;
+        pthread_cond_signal(&waiter->condVar);
+        if (waiter->isWriter)
+            break;
+    }
+}
+
+// acquire this fair reader-writer lock for reading (shared)
+void fair_read_lock(struct fair_rwlock *rwlock) {
+    pthread_mutex_lock(&rwlock->lock);
+    // join the current batch of readers only if nobody is queued,
+    // otherwise a queued writer could be overtaken indefinitely
+    if (!rwlock->writer && list_empty(&rwlock->listofThreads)) {
+        rwlock->readers++;
+    }
+    else {
+        fair_rwlock_wait(rwlock, false);
+    }
+    pthread_mutex_unlock(&rwlock->lock);
+}
+
+// release a read hold on this fair reader-writer lock
+void fair_read_unlock(struct fair_rwlock *rwlock) {
+    pthread_mutex_lock(&rwlock->lock);
+    if (--rwlock->readers == 0)
+        fair_rwlock_grant(rwlock);
+    pthread_mutex_unlock(&rwlock->lock);
+}
+
+// acquire this fair reader-writer lock for writing (exclusive)
+void fair_write_lock(struct fair_rwlock *rwlock) {
+    pthread_mutex_lock(&rwlock->lock);
+    if (!rwlock->writer && rwlock->readers == 0 && list_empty(&rwlock->listofThreads)) {
+        rwlock->writer = true;
+    }
+    else {
+        fair_rwlock_wait(rwlock, true);
+    }
+    pthread_mutex_unlock(&rwlock->lock);
+}
+
+// release a write hold on this fair reader-writer lock
+void fair_write_unlock(struct fair_rwlock *rwlock) {
+    pthread_mutex_lock(&rwlock->lock);
+    rwlock->writer = false;
+    fair_rwlock_grant(rwlock);
+    pthread_mutex_unlock(&rwlock->lock);
+}
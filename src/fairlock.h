@@ -1,31 +1,103 @@
+#ifndef __FAIRLOCK_H
+#define __FAIRLOCK_H
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 #include "list.h"
+#include "mpscq.h"
+
+// how a fair lock is implemented. Queue and ticket locks hand the lock
+// to waiters in the order in which they arrived; a barging lock lets
+// running threads take it first unless a waiter has waited too long.
+enum fair_lock_kind {
+    FAIR_LOCK_QUEUE,    // lock-free waiter queue + per-waiter cond var
+    FAIR_LOCK_TICKET,   // ticket counter + futex words (Linux only)
+    FAIR_LOCK_BARGE,    // barging, FIFO handoff to aged waiters (Linux only)
+};
+
+// waiters of a ticket lock park on slot[ticket % FAIR_LOCK_SLOTS], so
+// an unlock can wake the next ticket holder directly
+#define FAIR_LOCK_SLOTS 64
+
+// how long the oldest waiter of a barging lock may wait before the
+// lock is handed to it, in microseconds, unless set with FAIRLOCK_MAXWAIT
+#define FAIR_LOCK_MAXWAIT_US 1000
 
 struct fair_lock {
-    // pthread_cond_t fairCond;
-    bool isLocked;
-    pthread_mutex_t lock;
-    struct list listofThreads;
+    enum fair_lock_kind kind;
+    union {
+        struct {    // FAIR_LOCK_QUEUE
+            unsigned count;     // holder plus waiters, accessed atomically
+            struct mpsc_queue waiters;  // pushed by waiters without locking,
+                                        // popped by the lock holder
+        };
+        struct {    // FAIR_LOCK_TICKET, accessed with atomic builtins
+            unsigned next;      // next ticket to be handed out
+            unsigned owner;     // ticket that currently holds the lock
+            struct list morphed;// cond waiters holding reserved tickets,
+                                // in ticket order; owned by the lock holder
+            unsigned slot[FAIR_LOCK_SLOTS];     // futex words
+        };
+        struct {    // FAIR_LOCK_BARGE
+            unsigned held;      // 1 while the lock is held, accessed atomically
+            unsigned nwaiters;  // waiters on queue, accessed atomically
+            uint64_t maxwait;   // ns before the oldest waiter is handed the lock
+            pthread_mutex_t qlock;  // protects queue and its waiters' state
+            struct list queue;  // waiters in order of arrival
+        };
+    };
 };
 
 struct fair_cond{
-    //list that holds the threads
+    //list that holds the threads, protected by holding the fair lock,
+    //from which waiters are moved directly onto the fair lock's queue.
     struct list listofThreads;
-    pthread_mutex_t lock; // to protect the list
     struct fair_lock* fairlock;
 
 };
 
 struct fairwaiter {
     struct list_elem elem;
+    struct mpsc_elem qelem; // FAIR_LOCK_QUEUE: element of fair_lock.waiters
+    pthread_mutex_t mutex;  // FAIR_LOCK_QUEUE: protects state
     pthread_cond_t condVar;
+    bool isWriter;  // used by fair_rwlock: waiting for exclusive access
+    bool granted;   // set by the thread that hands off the lock
+    bool onCond;    // still queued on a fair_cond rather than the fair_lock
+    unsigned state; // see fairlock.c; FAIR_LOCK_TICKET: futex word
+    unsigned ticket;// FAIR_LOCK_TICKET: ticket reserved by a signal
+    uint64_t since; // FAIR_LOCK_BARGE: when it was queued for the lock, ns
+};
+
+// reader-writer lock: readers share, writers are exclusive.
+// Waiters are served in FIFO order; consecutive readers at the front
+// of the queue are admitted together as a batch, so neither readers
+// nor writers can starve.
+struct fair_rwlock {
+    int readers;        // number of readers currently holding the lock
+    bool writer;        // true if a writer currently holds the lock
+    pthread_mutex_t lock;
+    struct list listofThreads;
 };
 
-// create a new fair lock
+// create a new fair lock. The kind is taken from the FAIRLOCK
+// environment variable ("queue", "ticket" or "barge"), default "queue".
 struct fair_lock * fair_lock_new();
 
+// create a new fair lock of the given kind. A barging lock hands off
+// after FAIRLOCK_MAXWAIT microseconds, default FAIR_LOCK_MAXWAIT_US.
+struct fair_lock * fair_lock_new_kind(enum fair_lock_kind kind);
+
+// create a new barging fair lock whose oldest waiter is handed the lock
+// once it has waited `maxwait_us` microseconds
+struct fair_lock * fair_lock_new_barge(unsigned maxwait_us);
+
+// free a fair lock that nobody holds or waits for
+void fair_lock_free(struct fair_lock *lock);
+
 // lock this fair lock
 void fair_lock(struct fair_lock *lock);
 
@@ -35,8 +107,36 @@ void fair_unlock(struct fair_lock *lock);
 // wait on this fair condition variable
 void fair_cond_wait(struct fair_cond *cond);
 
-// wake up all threads waiting on that fair condition variable
+// wait on this fair condition variable, but no longer than `abstime`
+// (CLOCK_REALTIME). Returns 0 if signaled, ETIMEDOUT otherwise; in
+// both cases the fair lock is held again on return.
+int fair_cond_timedwait(struct fair_cond *cond, const struct timespec *abstime);
+
+// wake up one thread waiting on that fair condition variable.
+// Signal and broadcast must be called while holding the fair lock.
+void fair_cond_signal(struct fair_cond *cond);
+
+// wake up all threads waiting on that fair condition variable.
+// Waiters are moved onto the fair lock's queue in the order in which
+// they started waiting, and are woken one at a time as the lock is
+// handed to them.
 void fair_cond_broadcast(struct fair_cond *cond);
 
 // create a fair condition variable tied to the given fair lock
 struct fair_cond *fair_cond_new(struct fair_lock *lock);
+
+// create a new fair reader-writer lock
+struct fair_rwlock *fair_rwlock_new();
+
+// acquire this fair reader-writer lock for reading (shared)
+void fair_read_lock(struct fair_rwlock *rwlock);
+
+// release a read hold on this fair reader-writer lock
+void fair_read_unlock(struct fair_rwlock *rwlock);
+
+// acquire this fair reader-writer lock for writing (exclusive)
+void fair_write_lock(struct fair_rwlock *rwlock);
+
+// release a write hold on this fair reader-writer lock
+void fair_write_unlock(struct fair_rwlock *rwlock);
+#endif /* fairlock.h */
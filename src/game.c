@@ -0,0 +1,644 @@
+/*
+ * The rules of Dutch Blitz: dealing, finding and making moves,
+ * checking and scoring a game.
+ *
+ * None of these functions synchronize; callers must make sure that
+ * moves on the dutch piles are serialized.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <limits.h>
+
+#include "game.h"
+#include "rng.h"
+#include "cards.h"
+
+/* A Fisher-Yates shuffle */
+static void 
+fisher_yates(uint8_t *deck, uint8_t n, struct rng *rng)
+{
+    for (int i = n-1; i > 0; i--) {
+        int j = rng_below(rng, i+1);
+        uint8_t tmp = deck[j];
+        deck[j] = deck[i];
+        deck[i] = tmp;
+    }
+}
+
+/* Prepare a standard dutchblitz deck with a given bgcolor and shuffle it. */
+static void
+prepare_deck(uint8_t *deck, enum Color bgcolor, struct rng *rng)
+{
+    for (int fgcolor = 0; fgcolor < 4; fgcolor++)
+        for (int num = 0; num < 10; num++)
+            deck[10*fgcolor + num] = make_card(bgcolor, fgcolor, num);
+
+    fisher_yates(deck, 40, rng);
+}
+
+// name of player based on background color of their deck
+const char *
+player_name(struct player_state *player)
+{
+    return colors[player->bgcolor];
+}
+
+// reset the outcome of `g` before it is played
+void
+game_reset(struct game *g)
+{
+    g->winner = NULL;
+    g->deadlocked = 0;
+    g->blitzed = false;
+    g->moves = 0;
+    for (int i = 0; i < 4; i++)
+        g->stuckat[i] = g->searchedat[i] = -1;
+}
+
+// true if someone blitzed or all players are deadlocked
+bool
+game_over(struct game *g)
+{
+    return g->blitzed || g->deadlocked == 4;
+}
+
+// record that `player` cannot move until the dutch piles change.
+// Returns how many players are stuck on the dutch piles as they are now;
+// once that reaches 4, nobody can ever move again, and the state is
+// kept as the final one.
+int
+player_mark_deadlocked(struct game *g, struct player_state *player)
+{
+    struct game_state *gs = &g->state;
+    int dutchcards = gs->dutchcount[0] + gs->dutchcount[1]
+                   + gs->dutchcount[2] + gs->dutchcount[3];
+
+    if (g->deadlocked == 4)
+        return 4;
+    g->stuckat[player->bgcolor] = dutchcards;
+    g->deadlocked = 0;
+    for (int i = 0; i < 4; i++)
+        if (g->stuckat[i] == dutchcards)
+            g->deadlocked++;
+    if (g->deadlocked == 4)
+        game_state_copy(&g->final, gs);
+    return g->deadlocked;
+}
+
+const int BLITZED_FROM_POST = 256;  // player blitzed by moving cards to post pile
+const int PLAY_WOOD = 257;  // player is going to put a wood pile card to the dutch pile
+const int PLAY_BLITZ = 258; // player is going to put a blitz pile card to the dutch pile
+const int PLAY_POST = 259;  // player is going to put a post pile card to the dutch pile
+
+// check the consistency of the dutch piles started so far
+static void 
+validate_dutch(struct game_state *gs)
+{
+    for (int i = 0; i < gs->nextdutch; i++) {
+        for (int pos = 0; pos < pile_size(&gs->dutch[i]); pos++) {
+            uint8_t cp = gs->dutch[i]._cards[pos];
+            // check that dutch piles are in order 0, 1, 2 and have the
+            // same front color
+            assert (get_card_number(cp) == pos);        
+            assert (get_front_color(cp) == get_front_color(gs->dutch[i]._cards[0]));
+        }
+    }
+}
+
+// output dutch piles' content to file
+static void
+dump_dutch(struct game_state *gs, FILE *out, bool full)
+{
+    fprintf(out, "Dutch pile sizes:");
+    for (int i = 0; i < gs->nextdutch; i++)
+        fprintf(out, " %2d", pile_size(&gs->dutch[i]));
+    fprintf(out, "\n");
+    if (full) {
+        for (int i = 0; i < gs->nextdutch; i++) {
+            pile_dump(gs->dutch+i, out);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+// does card fit on dutch pile? 
+// if `play` is true, card will be added to dutch pile on which it fits
+// return true/false
+static bool
+fits_on_dutch_pile(struct game_state *gs, uint8_t card, bool play, FILE *out)
+{
+    if (get_card_number(card) == 0) {
+        if (play) {
+            assert(gs->nextdutch < 16);
+            pile_init(&gs->dutch[gs->nextdutch], 10);
+            pile_push(&gs->dutch[gs->nextdutch], card);
+            gs->dutchcount[get_back_color(card)]++;
+            if (out) {
+                fprintf(out, "%s puts ", colors[get_back_color(card)]);
+                print_card(card, false, out);
+                fprintf(out, " on dutch\n");
+            }
+            gs->nextdutch++;
+        }
+
+        return true;
+    }
+
+    for (int i = 0; i < gs->nextdutch; i++) {
+        uint8_t dtopcard = pile_top(&gs->dutch[i]);
+        if (follows_on_dutch(card, dtopcard)) {
+            if (play) {
+                pile_push(&gs->dutch[i], card);
+                gs->dutchcount[get_back_color(card)]++;
+                if (out) {
+                    fprintf(out, "%s puts ", colors[get_back_color(card)]);
+                    print_card(card, false, out);
+                    fprintf(out, "on dutch\n");
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// print this player's state.
+// should be called only if out != NULL
+static void
+player_print_state(struct player_state *player, FILE *out)
+{
+    fprintf(out, "Piles for player %s\n", player_name(player)); 
+    fprintf(out, "Blitzpile: ");
+    pile_dump(&player->blitz, out); 
+    fprintf(out, "\n");
+    for (int i = 0; i < 3; i++) {
+        fprintf(out, "Postpile#%d: ", i);
+        pile_dump(&player->post[i], out); 
+        fprintf(out, "\n");
+    }
+    fprintf(out, "Total cards in wood piles %d\n", 
+        pile_size(&player->woodpilediscard) + pile_size(&player->woodpiledraw));
+    fprintf(out, "Woodpile (discard): ");
+    pile_dump(&player->woodpilediscard, out); 
+    fprintf(out, "\n");
+    fprintf(out, "Woodpile (draw): ");
+    pile_dump(&player->woodpiledraw, out); 
+    fprintf(out, "\n");
+}
+
+// validate single post pile consistency
+static void 
+validate_post_pile(struct pile *pile)
+{
+    for (int i = pile->top - 1; i > 0; i--) {
+        uint8_t c1 = pile->_cards[i];
+        uint8_t c2 = pile->_cards[i-1];
+        assert(opposite_colors(get_front_color(c1), get_front_color(c2)));
+        assert(get_card_number(c1) + 1 == get_card_number(c2));
+        assert(get_back_color(c1) == get_back_color(c2));
+    }
+}
+
+// validate post piles consistency
+static void
+validate_post_piles(struct player_state *player)
+{
+    for (int i = 0; i < 3; i++)
+        if (!pile_empty(&player->post[i]))
+            validate_post_pile(&player->post[i]);
+}
+
+// count this player's cards on the dutch piles the slow way
+static int
+count_dutch_cards(struct game_state *gs, struct player_state *player)
+{
+    int n = 0;
+    for (int i = 0; i < gs->nextdutch; i++) {
+        for (int j = 0; j < gs->dutch[i].top; j++)
+            if (get_back_color(gs->dutch[i]._cards[j]) == player->bgcolor)
+                n++;
+    }
+    return n;
+}
+
+// check all invariants of a game state that is not being played,
+// e.g. after all player threads have been joined.
+void
+validate_game(struct game_state *gs)
+{
+    for (int i = 0; i < 4; i++) {
+        validate_post_piles(&gs->players[i]);
+        assert(count_dutch_cards(gs, &gs->players[i]) == gs->dutchcount[gs->players[i].bgcolor]);
+    }
+    validate_dutch(gs);
+}
+
+// output global state when someone blitzed
+void
+global_state_on_win(struct game_state *gs, struct player_state *winner, FILE *out)
+{
+    if (out) {
+        if (winner) {
+            fprintf(out, "Winner is:  %s\n", player_name(winner));
+            player_print_state(winner, out);
+            fprintf(out, "\nOther players:\n"); 
+        } else {
+            fprintf(out, "There was no winner:\n"); 
+        }
+        for (int i = 0; i < 4; i++) 
+            if (gs->players + i != winner) {
+                player_print_state(&gs->players[i], out);
+                fprintf(out, "\n");
+            }
+        dump_dutch(gs, out, winner == NULL);
+    }
+}
+
+// prepare a player's deck by dealing blitz, post, and wood piles
+static void
+player_deal(struct player_state *player, struct rng *rng)
+{
+    prepare_deck(player->deck, player->bgcolor, rng);
+
+    for (int i = 0; i < 3; i++) {
+        pile_init(&player->post[i], 10);
+        pile_push(&player->post[i], player->deck[i]);
+    }
+    pile_init(&player->blitz, 10);
+    pile_push_many(&player->blitz, player->deck + 3, 10);
+    pile_init(&player->woodpiledraw, 30);
+    pile_init(&player->woodpilediscard, 30);
+    pile_push_many(&player->woodpiledraw, player->deck + 13, 27);
+}
+
+// shuffle four decks and deal them, all determined by `seed`
+void
+game_deal(struct game_state *gs, uint64_t seed)
+{
+    struct rng rng;
+    rng_seed(&rng, seed);
+    for (int bgcolor = 0; bgcolor < 4; bgcolor++) {
+        gs->players[bgcolor].bgcolor = bgcolor;
+        player_deal(&gs->players[bgcolor], &rng);
+    }
+    gs->nextdutch = 0;
+    memset(gs->dutchcount, 0, sizeof gs->dutchcount);
+}
+
+// turn over the next 3 cards of the wood pile, turning the discard pile
+// back over when the draw pile runs out
+static void
+wood_flip_three(struct player_state *player)
+{
+    for (int i = 0; i < 3; i++) {
+        // replenish drawing pile from discard pile if out of drawing cards
+        if (pile_size(&player->woodpiledraw) == 0) {
+            while (pile_size(&player->woodpilediscard) > 0) {
+                pile_push(&player->woodpiledraw, pile_pop(&player->woodpilediscard));
+            }
+        }
+        // flip card over
+        pile_push(&player->woodpilediscard, pile_pop(&player->woodpiledraw));
+    }
+}
+
+// the piles a round of player_find_possible_move() reads and changes,
+// to detect when the rounds go in circles
+struct player_piles {
+    struct pile woodpiledraw;
+    struct pile woodpilediscard;
+    struct pile post[3];
+    struct pile blitz;
+};
+
+static void
+player_piles_save(struct player_piles *saved, struct player_state *player)
+{
+    saved->woodpiledraw = player->woodpiledraw;
+    saved->woodpilediscard = player->woodpilediscard;
+    for (int i = 0; i < 3; i++)
+        saved->post[i] = player->post[i];
+    saved->blitz = player->blitz;
+}
+
+static bool
+pile_equal(const struct pile *a, const struct pile *b)
+{
+    return a->top == b->top && memcmp(a->_cards, b->_cards, a->top) == 0;
+}
+
+static bool
+player_piles_equal(const struct player_piles *saved, struct player_state *player)
+{
+    return pile_equal(&saved->woodpiledraw, &player->woodpiledraw)
+        && pile_equal(&saved->woodpilediscard, &player->woodpilediscard)
+        && pile_equal(&saved->post[0], &player->post[0])
+        && pile_equal(&saved->post[1], &player->post[1])
+        && pile_equal(&saved->post[2], &player->post[2])
+        && pile_equal(&saved->blitz, &player->blitz);
+}
+
+// Play my deck, being able to read from, but not write to,
+// the dutch piles
+// Returns 
+//  - a 1 card to put on dutch pile if one is available to play
+//  - PLAY_BLITZ or PLAY_POST+0, +1, +2 if an attempt should be made to
+//      play blitz or the first, second, or third post pile.
+//  - PLAY_WOOD if the top of the wood pile can be dutched
+//
+//  -1 if no actions are possible until something moves in the dutch piles
+static uint32_t
+player_find_possible_move(struct game_state *gs, struct player_state *player, FILE *out)
+{
+    const int NROUNDS = 500;
+    int resetsleft = 3;
+
+    // Once the resets are used up and the whole wood pile has been
+    // seen twice, every round does the same to the piles, so they go
+    // in a cycle unless a card finds a place. Brent's algorithm finds
+    // the cycle: `saved` holds the piles as they were `cycle` rounds
+    // ago, and moves up whenever `cycle` reaches a power of two.
+    struct player_piles saved;
+    bool tracking = false;
+    int cycle = 0, power = 1;
+
+    for (int rounds = 0; rounds < NROUNDS; rounds++) {
+        // check if any blitz card can be put on the dutch pile
+        if (!pile_empty(&player->blitz) && fits_on_dutch_pile(gs, pile_top(&player->blitz), false, out))
+            return PLAY_BLITZ;
+
+        // check if any post pile cards can be placed onto the dutch pile
+        for (int j = 0; j < 3; j++) {
+            if (!pile_empty(&player->post[j])) {
+                if (fits_on_dutch_pile(gs, pile_top(&player->post[j]), false, out))
+                    return PLAY_POST + j;
+            }
+        }
+
+        // see if any blitz cards can be moved onto post pile.
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (int i = 0; !pile_empty(&player->blitz) && i < 3; i++) {
+                uint8_t btopcard = pile_top(&player->blitz);
+                if (pile_empty(&player->post[i])) {
+                    pile_push(&player->post[i], pile_pop(&player->blitz));
+                    moved = true;
+                } else {
+                    uint8_t to = pile_top(&player->post[i]);
+                    if (fits_on_post(btopcard, to)) {
+                        pile_push(&player->post[i], pile_pop(&player->blitz));
+                        moved = true;
+                    }
+                }
+            }
+        }
+        if (pile_empty(&player->blitz))
+            return BLITZED_FROM_POST;
+
+        // now we have a choice to make - serve the wood pile first,
+        // or try to consolidate the post piles.
+        //
+        // Check if post piles can be consolidated, starting with 
+        // the post pile with the highest number.
+        // For instance, if we have 3red, 4yellow, 5red we want to
+        // move 4yellow onto 5red first, then 3red onto 4yellow.
+        for (int cnum = 8; cnum >= 1; cnum--) {
+            for (int i = 0; i < 3; i++) {
+                if (pile_size(&player->post[i]) == 1) { // can move only single cards
+                    uint8_t from = pile_top(&player->post[i]);
+                    if (get_card_number(from) == cnum) {
+                        for (int j = 0; j < 3; j++) if (i != j) {
+                            if (pile_size(&player->post[j]) == 1) {
+                                uint8_t to = pile_top(&player->post[j]);
+                                if (fits_on_post(from, to)) {
+                                    pile_push(&player->post[j], pile_pop(&player->post[i]));
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if (pile_size(&player->woodpiledraw) == 0 && pile_size(&player->woodpilediscard) == 0) {
+            if (out)
+                fprintf(out, "player %s ran out of wood piles\n", player_name(player));
+            return -1;
+        }
+
+        // now it's time to sift through the wood pile. We must go in steps of 3.
+        // we may run out at any step and may need to flip the woodpile draw over 
+        wood_flip_three(player);
+
+        // now check if the top card of the woodpile discard can be put on the dutch pile.
+        if (fits_on_dutch_pile(gs, pile_top(&player->woodpilediscard), false, out))
+            return PLAY_WOOD;
+
+        // at this point, we could try to place the top of the wood pile onto
+        // a post pile.  However, this is risky - the rules manual actually advises
+        // against it since it pads the post piles, making it less likely to accommodate
+        // cards from the blitz pile.  But it may be needed to get a game unstuck,
+        // particularly if the number of cards on the wood post pile is a multiple
+        // of 3, that is, only 1/3 of the cards are looked at.
+        // let's do that only after we've played through the complete woodpile at least once.
+        //
+        if (rounds > (pile_size(&player->woodpiledraw) + pile_size(&player->woodpilediscard))) {
+            uint8_t wtopcard = pile_top(&player->woodpilediscard);
+
+            for (int i = 0; i < 3; i++) {
+                // should not be empty since we would have placed blitz card here
+                assert (!pile_empty(&player->post[i]));
+
+                uint8_t to = pile_top(&player->post[i]);
+                if (fits_on_post(wtopcard, to)) {
+                    pile_push(&player->post[i], pile_pop(&player->woodpilediscard));
+                    break;
+                }
+            }
+        }
+
+        // As the rules say, if a player believes they are stuck, they can move the top 
+        // of the wood discard pile and place it on the bottom.
+        // we do this only after having recycle the wood pile a few times
+        if (rounds > 2 * (pile_size(&player->woodpiledraw) + pile_size(&player->woodpilediscard))) {
+            if (!pile_empty(&player->woodpiledraw))
+                if (resetsleft > 0) {
+                    pile_rotate_top_card_down(&player->woodpiledraw);
+                    resetsleft--;
+                    rounds = 0;
+                }
+        }
+
+        if (resetsleft == 0
+            && rounds > 2 * (pile_size(&player->woodpiledraw) + pile_size(&player->woodpilediscard))) {
+            if (tracking) {
+                cycle++;
+                if (player_piles_equal(&saved, player)) {
+                    // nothing will fit for the rest of the rounds either. Leave
+                    // the wood pile as it would be after them, and give up now.
+                    for (int left = (NROUNDS - 1 - rounds) % cycle; left > 0; left--)
+                        wood_flip_three(player);
+                    return -1;
+                }
+            }
+            if (!tracking || cycle == power) {
+                player_piles_save(&saved, player);
+                tracking = true;
+                if (cycle == power)
+                    power *= 2;
+                cycle = 0;
+            }
+        }
+    }
+    // we run out of rounds - we conclude that we must wait for some action on the dutch piles
+    return -1;
+}
+
+// check that a game that ended because all players were stuck ended on
+// dutch piles on which every player's last search found no move, so that
+// no stuck verdict was cached for piles the player never searched
+void
+validate_stuck(const struct game *g)
+{
+    const struct game_state *gs = &g->final;
+    int dutchcards = gs->dutchcount[0] + gs->dutchcount[1]
+                   + gs->dutchcount[2] + gs->dutchcount[3];
+    for (int i = 0; i < 4; i++) {
+        assert(g->stuckat[i] == dutchcards);
+        assert(g->searchedat[i] == dutchcards);
+    }
+}
+
+// decide on this player's next move, see player_find_possible_move()
+uint32_t
+player_decide_move(struct game *g, struct player_state *player, FILE *out)
+{
+    // a player whose search found no move stays stuck until the dutch
+    // piles change: searching their piles again would only go through
+    // the same cycles. The verdict is cached against the dutch cards
+    // the search saw, which nobody can change while we hold the lock.
+    struct game_state *gs = &g->state;
+    int dutchcards = gs->dutchcount[0] + gs->dutchcount[1]
+                   + gs->dutchcount[2] + gs->dutchcount[3];
+    uint32_t action = -1;
+    if (g->searchedat[player->bgcolor] != dutchcards) {
+        action = player_find_possible_move(gs, player, out);
+        if (action == -1)
+            g->searchedat[player->bgcolor] = dutchcards;
+    }
+    if (action == -1 && out)
+        fprintf(out, "player %s stuck deadlocked %d\n", player_name(player), g->deadlocked);
+    return action;
+}
+
+// carry out a move decided on by player_decide_move(). The dutch piles
+// may have changed since, in which case the card no longer fits.
+//
+// May set blitzed if move led to this player blitzing
+enum move_result
+player_commit_move(struct game *g, struct player_state *player, uint32_t action, FILE *out)
+{
+    struct game_state *gs = &g->state;
+    bool iblitzed = false;
+    bool madeplay = false;
+    if (action == -1 || game_over(g))
+        return MOVE_NONE;
+
+    if (action == BLITZED_FROM_POST) {
+        iblitzed = true;
+    } else
+    if (action == PLAY_WOOD) {
+        if (fits_on_dutch_pile(gs, pile_top(&player->woodpilediscard), true, out)) {
+            pile_pop(&player->woodpilediscard);
+            madeplay = true;
+        }
+    } else
+    if (action == PLAY_BLITZ) {
+        if (fits_on_dutch_pile(gs, pile_top(&player->blitz), true, out)) {
+            pile_pop(&player->blitz);
+            if (pile_empty(&player->blitz)) {
+                iblitzed = true;
+            }
+            madeplay = true;
+        }
+    } else 
+    if (PLAY_POST <= action && action <= PLAY_POST + 2) {
+        if (fits_on_dutch_pile(gs, pile_top(&player->post[action-PLAY_POST]), true, out)) {
+            pile_pop(&player->post[action-PLAY_POST]);
+            madeplay = true;
+        }
+    }
+
+    if (iblitzed) {
+        g->blitzed = true;
+        g->winner = player;
+        madeplay = true;
+    }
+    if (!madeplay)
+        return MOVE_STALE;
+    g->moves++;
+    if (iblitzed)
+        game_state_copy(&g->final, gs);
+    return MOVE_COMMITTED;
+}
+
+// try to play your pile and make up to one move related to the dutch pile
+// return true if a move was made
+//        false if no move could be made
+//
+// May set blitzed if move led to this player blitzing
+bool
+player_try_to_make_one_move(struct game *g, struct player_state *player, FILE *out)
+{
+    uint32_t action = player_decide_move(g, player, out);
+    return player_commit_move(g, player, action, out) == MOVE_COMMITTED;
+}
+
+// compute score for this player
+static int
+score_player(struct game_state *gs, struct player_state *player)
+{
+    int s = -2 * pile_size(&player->blitz);     // -2 for each card left in blitz pile
+    s += gs->dutchcount[player->bgcolor];           // +1 for each card in the dutch pile
+    return s;
+}
+
+// compute score for all players
+void
+score_all_players(struct game_state *gs, int scores[4], FILE *out)
+{
+    for (int i = 0; i < 4; i++) {
+        scores[i] = score_player(gs, &gs->players[i]);
+        if (out)
+            fprintf(out, "%d ", scores[i]);
+    }
+    if (out)
+        fprintf(out, "\n");
+}
+
+// play a game on the calling thread: players take turns in seat order,
+// each making at most one move per turn, until the game is over
+void
+game_play_sequential(struct game *g, FILE *out)
+{
+    game_play_rounds(g, INT_MAX, out);
+}
+
+// play whole rounds until the game is over or `moves` moves have been made
+void
+game_play_rounds(struct game *g, int moves, FILE *out)
+{
+    while (!game_over(g) && g->moves < moves) {
+        for (int i = 0; i < 4 && !game_over(g); i++) {
+            struct player_state *player = &g->state.players[i];
+            if (!player_try_to_make_one_move(g, player, out))
+                player_mark_deadlocked(g, player);
+        }
+    }
+}
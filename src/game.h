@@ -0,0 +1,160 @@
+#ifndef __GAME_H
+#define __GAME_H
+/*
+ * Game state and rules of Dutch Blitz, independent of how the
+ * players are run.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pile.h"
+#include "gamelock.h"
+#include "combine.h"
+
+// the play state of a player.
+// Only the player's own thread writes it, on nearly every turn, so each
+// player gets cache lines of their own: a move must not invalidate the
+// lines another player is reading. The piles it plays from come first,
+// the deck, which is only read when dealing, last.
+struct player_state {
+    struct pile woodpiledraw;   // wood pile in hand to draw from
+    struct pile woodpilediscard;// wood pile on table to discard to
+    struct pile post[3];        // post piles: stack
+    struct pile blitz;          // blitz pile: stack
+    uint8_t bgcolor;            // that player's bgcolor, also their name
+    uint8_t deck[40];           // deck from which the piles were dealt
+} __attribute__((aligned(64)));
+
+// everything that determines how a game continues.
+// There are no pointers in here, so a game state can be snapshotted
+// and restored with game_state_copy() and saved to disk.
+struct game_state {
+    struct player_state players[4]; // state of each player
+    // written by whoever holds the game lock, read by everyone
+    struct pile dutch[16] __attribute__((aligned(64)));
+                                    // 16 dutch piles: 4 of each color (4x threads)
+    int nextdutch;                  // index of next dutch pile to be started
+    int dutchcount[4];              // cards on dutch piles, by back color
+};
+
+// a game in progress.
+// Fields are grouped by who writes them how often, each group on cache
+// lines of its own.
+struct game {
+    struct game_state state;
+
+    // read by every player on every turn through game_over(), written
+    // only when a player gets stuck or someone blitzes
+    bool blitzed __attribute__((aligned(64)));
+                                    // true if someone blitzed in this game
+    struct player_state *winner;    // winner who has blitzed
+    int deadlocked;                 // how many players are currently deadlocked
+    int stuckat[4];                 // cards on the dutch piles when each player
+                                    // last got stuck, -1 if not stuck
+    int searchedat[4];              // cards on the dutch piles when each player's
+                                    // last search found no move, -1 if none
+
+    // written on every move
+    struct game_lock lock __attribute__((aligned(64)));
+                                    // protects the dutch piles
+    int moves;                      // moves committed so far
+
+    // commits posted by players with COMMIT=combine, run under `lock`
+    struct combiner combiner;
+
+    // a barrier in an attempt to let threads start at roughly the same time
+    pthread_barrier_t readysetgo __attribute__((aligned(64)));
+
+    // the state as it was when the game ended, taken under the lock;
+    // the outcome is reported and scored from this once all players are done
+    struct game_state final;
+};
+
+// name of player based on background color of their deck
+const char *player_name(struct player_state *player);
+
+// shuffle four decks and deal them, all determined by `seed`
+void game_deal(struct game_state *gs, uint64_t seed);
+
+// reset the outcome of `g` before it is played
+void game_reset(struct game *g);
+
+// true if someone blitzed or all players are deadlocked
+bool game_over(struct game *g);
+
+// record that `player` cannot move until the dutch piles change;
+// returns the number of players that are stuck. Once that reaches 4,
+// the game is over and its final state is kept in g->final.
+// Must be called in the critical section in which the player failed to
+// find a move, so that it is marked stuck on the piles it searched.
+int player_mark_deadlocked(struct game *g, struct player_state *player);
+
+// what became of a move
+enum move_result {
+    MOVE_NONE,          // there was no move to make
+    MOVE_COMMITTED,     // the move was made
+    MOVE_STALE,         // the card no longer fits on the dutch piles
+};
+
+// decide on this player's next move, possibly rearranging the player's
+// own piles. Reads the dutch piles. Returns -1 if no move is possible
+// until the dutch piles change.
+uint32_t player_decide_move(struct game *g, struct player_state *player, FILE *out);
+
+// carry out a move returned by player_decide_move(). Once the game is
+// over, no more moves are made.
+enum move_result player_commit_move(struct game *g, struct player_state *player,
+                                    uint32_t action, FILE *out);
+
+// try to play your pile and make up to one move related to the dutch pile
+// return true if a move was made
+bool player_try_to_make_one_move(struct game *g, struct player_state *player, FILE *out);
+
+// play a game on the calling thread, players taking turns in seat order
+void game_play_sequential(struct game *g, FILE *out);
+
+// as game_play_sequential(), but stop after the first round at the end
+// of which `moves` moves have been made
+void game_play_rounds(struct game *g, int moves, FILE *out);
+
+// check all invariants of a game state that is not being played
+void validate_game(struct game_state *gs);
+
+// check that a game that ended because all players were stuck ended on
+// dutch piles that every player searched without finding a move
+void validate_stuck(const struct game *g);
+
+// output global state when someone blitzed, or the game ended without winner
+void global_state_on_win(struct game_state *gs, struct player_state *winner, FILE *out);
+
+// compute score for all players
+void score_all_players(struct game_state *gs, int scores[4], FILE *out);
+
+// snapshot or restore a game state
+void game_state_copy(struct game_state *dst, const struct game_state *src);
+
+// largest number of bytes game_state_encode() produces
+#define GAME_STATE_MAXENCODED 1024
+
+// compact encoding of a game state: only the cards that are present.
+// Returns the number of bytes written to `buf`.
+size_t game_state_encode(const struct game_state *gs, uint8_t *buf);
+
+// decode a game state encoded by game_state_encode().
+// Returns false if `buf` does not hold a valid game state.
+bool game_state_decode(struct game_state *gs, const uint8_t *buf, size_t len);
+
+// write a game state to a file; returns false on I/O error
+bool game_state_save(const struct game_state *gs, FILE *file);
+
+// read a game state written by game_state_save()
+bool game_state_load(struct game_state *gs, FILE *file);
+
+// check that a game dealt as `deal`, played sequentially, ends the same
+// way when it is snapshotted halfway and played on from the snapshot,
+// or from the snapshot saved and loaded again
+void validate_snapshot_restore(const struct game_state *deal);
+#endif /* game.h */
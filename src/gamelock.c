@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "gamelock.h"
+#include "coro.h"
+
+static const char *names[GAME_LOCK_KINDS] = { "pthread", "fair", "ticket", "barge", "spin" };
+
+// spin this many times before yielding the CPU
+static const int SPIN_TRIES = 100;
+
+// name of a lock kind
+const char *
+game_lock_kind_name(enum game_lock_kind kind)
+{
+    return names[kind];
+}
+
+// look up a lock kind by name
+bool
+game_lock_kind_parse(const char *name, enum game_lock_kind *kind)
+{
+    for (int i = 0; i < GAME_LOCK_KINDS; i++) {
+        if (!strcmp(name, names[i])) {
+            *kind = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+game_lock_init(struct game_lock *lock, enum game_lock_kind kind)
+{
+    lock->kind = kind;
+    switch (kind) {
+    case GAME_LOCK_PTHREAD:
+        pthread_mutex_init(&lock->mutex, NULL);
+        break;
+    case GAME_LOCK_FAIR:
+        lock->fair = fair_lock_new_kind(FAIR_LOCK_QUEUE);
+        break;
+    case GAME_LOCK_TICKET:
+        lock->fair = fair_lock_new_kind(FAIR_LOCK_TICKET);
+        break;
+    case GAME_LOCK_BARGE:
+        lock->fair = fair_lock_new_kind(FAIR_LOCK_BARGE);
+        break;
+    default:
+        lock->spin = 0;
+    }
+}
+
+void
+game_lock_destroy(struct game_lock *lock)
+{
+    switch (lock->kind) {
+    case GAME_LOCK_PTHREAD:
+        pthread_mutex_destroy(&lock->mutex);
+        break;
+    case GAME_LOCK_FAIR:
+    case GAME_LOCK_TICKET:
+    case GAME_LOCK_BARGE:
+        fair_lock_free(lock->fair);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+spin_lock(int *spin)
+{
+    while (__atomic_exchange_n(spin, 1, __ATOMIC_ACQUIRE)) {
+        // wait for the lock to look free before trying again, so that
+        // waiters do not keep stealing the holder's cache line
+        for (int i = 0; __atomic_load_n(spin, __ATOMIC_RELAXED); i++)
+            if (i >= SPIN_TRIES)
+                coro_yield();
+    }
+}
+
+void
+game_lock(struct game_lock *lock)
+{
+    switch (lock->kind) {
+    case GAME_LOCK_PTHREAD:
+        pthread_mutex_lock(&lock->mutex);
+        break;
+    case GAME_LOCK_FAIR:
+    case GAME_LOCK_TICKET:
+    case GAME_LOCK_BARGE:
+        fair_lock(lock->fair);
+        break;
+    default:
+        spin_lock(&lock->spin);
+    }
+}
+
+void
+game_unlock(struct game_lock *lock)
+{
+    switch (lock->kind) {
+    case GAME_LOCK_PTHREAD:
+        pthread_mutex_unlock(&lock->mutex);
+        break;
+    case GAME_LOCK_FAIR:
+    case GAME_LOCK_TICKET:
+    case GAME_LOCK_BARGE:
+        fair_unlock(lock->fair);
+        break;
+    default:
+        __atomic_store_n(&lock->spin, 0, __ATOMIC_RELEASE);
+    }
+}
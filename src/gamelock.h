@@ -0,0 +1,44 @@
+#ifndef __GAMELOCK_H
+#define __GAMELOCK_H
+/*
+ * The lock that protects a game's dutch piles, with an implementation
+ * chosen at startup. The kinds trade throughput against fairness:
+ * fair and ticket hand the lock to players in arrival order, pthread
+ * and spin let whoever grabs it first have it, and barge does too until
+ * a player has waited longer than FAIRLOCK_MAXWAIT.
+ */
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "fairlock.h"
+
+enum game_lock_kind {
+    GAME_LOCK_PTHREAD,  // pthread_mutex_t
+    GAME_LOCK_FAIR,     // fair_lock, FAIR_LOCK_QUEUE
+    GAME_LOCK_TICKET,   // fair_lock, FAIR_LOCK_TICKET
+    GAME_LOCK_BARGE,    // fair_lock, FAIR_LOCK_BARGE
+    GAME_LOCK_SPIN,     // test-and-test-and-set, yields while spinning,
+                        // to the next coroutine when run by one
+    GAME_LOCK_KINDS
+};
+
+struct game_lock {
+    enum game_lock_kind kind;
+    union {
+        pthread_mutex_t mutex;  // GAME_LOCK_PTHREAD
+        struct fair_lock *fair; // GAME_LOCK_FAIR, GAME_LOCK_TICKET, GAME_LOCK_BARGE
+        int spin;               // GAME_LOCK_SPIN, accessed atomically
+    };
+};
+
+// name of a lock kind, as accepted by game_lock_kind_parse()
+const char *game_lock_kind_name(enum game_lock_kind kind);
+
+// look up a lock kind by name; returns false if there is none
+bool game_lock_kind_parse(const char *name, enum game_lock_kind *kind);
+
+void game_lock_init(struct game_lock *lock, enum game_lock_kind kind);
+void game_lock_destroy(struct game_lock *lock);
+void game_lock(struct game_lock *lock);
+void game_unlock(struct game_lock *lock);
+#endif /* gamelock.h */
@@ -0,0 +1,253 @@
+/*
+ * Snapshots and serialization of game states.
+ *
+ * A struct game_state holds no pointers, so snapshots are plain copies,
+ * and a game can be played on from a snapshot as often as needed, e.g.
+ * for rollouts from one mid-game position. The serialized form stores
+ * only the cards present in each pile:
+ *
+ *   per player:  bgcolor, deck[40], then for the wood draw, wood discard,
+ *                3 post and the blitz pile: cap, size, cards[size]
+ *   nextdutch, then for each started dutch pile: cap, size, cards[size]
+ *
+ * Files written by game_state_save() start with a 4 byte magic and a
+ * version byte, followed by a 2 byte length and the encoded state.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "game.h"
+
+static const char MAGIC[4] = "DBGS";
+static const uint8_t VERSION = 1;
+
+// snapshot or restore a game state
+void
+game_state_copy(struct game_state *dst, const struct game_state *src)
+{
+    memcpy(dst, src, sizeof *dst);
+}
+
+static uint8_t *
+encode_pile(const struct pile *pile, uint8_t *buf)
+{
+    *buf++ = pile->cap;
+    *buf++ = pile->top;
+    memcpy(buf, pile->_cards, pile->top);
+    return buf + pile->top;
+}
+
+// compact encoding of a game state: only the cards that are present.
+size_t
+game_state_encode(const struct game_state *gs, uint8_t *buf)
+{
+    uint8_t *p = buf;
+    for (int i = 0; i < 4; i++) {
+        const struct player_state *player = &gs->players[i];
+        *p++ = player->bgcolor;
+        memcpy(p, player->deck, sizeof player->deck);
+        p += sizeof player->deck;
+        p = encode_pile(&player->woodpiledraw, p);
+        p = encode_pile(&player->woodpilediscard, p);
+        for (int j = 0; j < 3; j++)
+            p = encode_pile(&player->post[j], p);
+        p = encode_pile(&player->blitz, p);
+    }
+    *p++ = gs->nextdutch;
+    for (int i = 0; i < gs->nextdutch; i++)
+        p = encode_pile(&gs->dutch[i], p);
+    return p - buf;
+}
+
+// decoding cursor that fails instead of reading past the end
+struct reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool ok;
+};
+
+static uint8_t
+read_byte(struct reader *r)
+{
+    if (r->p >= r->end) {
+        r->ok = false;
+        return 0;
+    }
+    return *r->p++;
+}
+
+static bool
+valid_card(uint8_t card)
+{
+    return (card & 0xf) < 10;
+}
+
+static void
+decode_pile(struct pile *pile, struct reader *r)
+{
+    pile->cap = read_byte(r);
+    pile->top = read_byte(r);
+    if (pile->cap > PILE_MAXCAP || pile->top > pile->cap || r->end - r->p < pile->top) {
+        r->ok = false;
+        pile->top = 0;
+        return;
+    }
+    for (int i = 0; i < pile->top; i++) {
+        pile->_cards[i] = *r->p++;
+        if (!valid_card(pile->_cards[i]))
+            r->ok = false;
+    }
+}
+
+// decode a game state encoded by game_state_encode().
+bool
+game_state_decode(struct game_state *gs, const uint8_t *buf, size_t len)
+{
+    struct reader r = { buf, buf + len, true };
+
+    memset(gs, 0, sizeof *gs);
+    for (int i = 0; i < 4 && r.ok; i++) {
+        struct player_state *player = &gs->players[i];
+        player->bgcolor = read_byte(&r);
+        if (player->bgcolor != i)
+            r.ok = false;
+        for (int j = 0; j < 40; j++)
+            player->deck[j] = read_byte(&r);
+        decode_pile(&player->woodpiledraw, &r);
+        decode_pile(&player->woodpilediscard, &r);
+        for (int j = 0; j < 3; j++)
+            decode_pile(&player->post[j], &r);
+        decode_pile(&player->blitz, &r);
+    }
+    gs->nextdutch = read_byte(&r);
+    if (gs->nextdutch > 16)
+        return false;
+    for (int i = 0; i < gs->nextdutch && r.ok; i++) {
+        decode_pile(&gs->dutch[i], &r);
+        for (int j = 0; j < gs->dutch[i].top; j++)
+            gs->dutchcount[gs->dutch[i]._cards[j] >> 6]++;
+    }
+    return r.ok && r.p == r.end;
+}
+
+// write a game state to a file; returns false on I/O error
+bool
+game_state_save(const struct game_state *gs, FILE *file)
+{
+    uint8_t buf[GAME_STATE_MAXENCODED];
+    size_t len = game_state_encode(gs, buf);
+    uint8_t header[7] = { MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3], VERSION, len & 0xff, len >> 8 };
+
+    return fwrite(header, sizeof header, 1, file) == 1
+        && fwrite(buf, len, 1, file) == 1;
+}
+
+// read a game state written by game_state_save()
+bool
+game_state_load(struct game_state *gs, FILE *file)
+{
+    uint8_t header[7];
+    uint8_t buf[GAME_STATE_MAXENCODED];
+
+    if (fread(header, sizeof header, 1, file) != 1
+        || memcmp(header, MAGIC, sizeof MAGIC) || header[4] != VERSION)
+        return false;
+    size_t len = header[5] | header[6] << 8;
+    if (len > sizeof buf || fread(buf, len, 1, file) != 1)
+        return false;
+    return game_state_decode(gs, buf, len);
+}
+
+// a game played on the calling thread, paused between two rounds
+struct game_snapshot {
+    struct game_state state;
+    int moves;
+    int deadlocked;
+    int stuckat[4];
+    int searchedat[4];
+};
+
+static void
+game_snapshot_take(struct game_snapshot *snap, struct game *g)
+{
+    game_state_copy(&snap->state, &g->state);
+    snap->moves = g->moves;
+    snap->deadlocked = g->deadlocked;
+    memcpy(snap->stuckat, g->stuckat, sizeof snap->stuckat);
+    memcpy(snap->searchedat, g->searchedat, sizeof snap->searchedat);
+}
+
+static void
+game_snapshot_restore(struct game *g, const struct game_snapshot *snap)
+{
+    game_reset(g);
+    game_state_copy(&g->state, &snap->state);
+    g->moves = snap->moves;
+    g->deadlocked = snap->deadlocked;
+    memcpy(g->stuckat, snap->stuckat, sizeof g->stuckat);
+    memcpy(g->searchedat, snap->searchedat, sizeof g->searchedat);
+}
+
+// true if two game states hold the same cards in the same places.
+// Slots above the top of a pile may differ, so compare the encodings.
+static bool
+game_state_equal(const struct game_state *a, const struct game_state *b)
+{
+    uint8_t bufa[GAME_STATE_MAXENCODED], bufb[GAME_STATE_MAXENCODED];
+    size_t lena = game_state_encode(a, bufa);
+    size_t lenb = game_state_encode(b, bufb);
+    return lena == lenb && memcmp(bufa, bufb, lena) == 0;
+}
+
+// write the state of `snap` with game_state_save() and read it back
+// with game_state_load() into `loaded`, keeping the rest of `snap`
+static void
+game_snapshot_reload(struct game_snapshot *loaded, const struct game_snapshot *snap)
+{
+    char buf[7 + GAME_STATE_MAXENCODED];
+    FILE *file = fmemopen(buf, sizeof buf, "w+");
+    assert(file != NULL);
+    *loaded = *snap;
+    bool saved = game_state_save(&snap->state, file);
+    rewind(file);
+    bool ok = saved && game_state_load(&loaded->state, file);
+    fclose(file);
+    assert(ok);
+}
+
+// play a game dealt as `deal` sequentially, snapshotting it after the
+// first round in which PAUSE_MOVES moves have been made; then play it
+// on from the snapshot, and from the snapshot saved and loaded again,
+// and check that both times it ends exactly as it did without the pause.
+void
+validate_snapshot_restore(const struct game_state *deal)
+{
+    const int PAUSE_MOVES = 20;
+    struct game g;
+    struct game_snapshot snap, loaded;
+    struct game_state final;
+
+    game_reset(&g);
+    game_state_copy(&g.state, deal);
+    game_play_rounds(&g, PAUSE_MOVES, NULL);
+    if (game_over(&g))
+        return;
+    game_snapshot_take(&snap, &g);
+    game_play_sequential(&g, NULL);
+    game_state_copy(&final, &g.final);
+    int moves = g.moves;
+    int winner = g.blitzed ? g.winner->bgcolor : -1;
+
+    game_snapshot_reload(&loaded, &snap);
+    assert(game_state_equal(&loaded.state, &snap.state));
+    for (int i = 0; i < 2; i++) {
+        game_snapshot_restore(&g, i == 0 ? &snap : &loaded);
+        game_play_sequential(&g, NULL);
+        assert(g.moves == moves);
+        assert((g.blitzed ? g.winner->bgcolor : -1) == winner);
+        assert(game_state_equal(&g.final, &final));
+    }
+}
@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "hist.h"
+
+static const int SUB_BUCKETS = 1 << HIST_SUB_BITS;
+
+// bucket that counts `value`
+static int
+bucket_of(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+    int magnitude = 63 - __builtin_clzll(value);        // >= HIST_SUB_BITS
+    int shift = magnitude - HIST_SUB_BITS;
+    int bucket = ((shift + 1) << HIST_SUB_BITS) + (value >> shift) - SUB_BUCKETS;
+    return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+// largest value counted by `bucket`
+static uint64_t
+bucket_max(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t) (SUB_BUCKETS + (bucket & (SUB_BUCKETS - 1))) << shift;
+    return low + ((uint64_t) 1 << shift) - 1;
+}
+
+// make `h` empty
+void
+hist_init(struct hist *h)
+{
+    memset(h, 0, sizeof *h);
+}
+
+// count `value`
+void
+hist_record(struct hist *h, uint64_t value)
+{
+    h->counts[bucket_of(value)]++;
+    h->count++;
+    if (value > h->max)
+        h->max = value;
+}
+
+// add the counts of `src` to `dst`
+void
+hist_merge(struct hist *dst, const struct hist *src)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+        dst->counts[i] += src->counts[i];
+    dst->count += src->count;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+// value at percentile `pct`, up to the bucket resolution
+uint64_t
+hist_percentile(const struct hist *h, double pct)
+{
+    uint64_t rank = pct / 100.0 * h->count;
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_max(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
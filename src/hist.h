@@ -0,0 +1,36 @@
+#ifndef __HIST_H
+#define __HIST_H
+/*
+ * Log-linear histograms in the style of HdrHistogram.
+ *
+ * Values below 2^HIST_SUB_BITS are counted exactly; above that, each
+ * power of two is split into 2^HIST_SUB_BITS equal buckets, so every
+ * recorded value is known to within 1/16 (6.25%) of itself. Recording
+ * is a few shifts and an increment, and histograms of the same shape
+ * can be merged by adding their counts.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS (40 << HIST_SUB_BITS)  // values up to 2^43 - 1
+
+struct hist {
+    uint64_t count;             // values recorded
+    uint64_t max;               // largest value recorded
+    uint64_t counts[HIST_BUCKETS];
+};
+
+// make `h` empty
+void hist_init(struct hist *h);
+
+// count `value`; values too large for the histogram count as the largest
+void hist_record(struct hist *h, uint64_t value);
+
+// add the counts of `src` to `dst`
+void hist_merge(struct hist *dst, const struct hist *src);
+
+// smallest value v such that `pct` percent of the recorded values are <= v,
+// up to the bucket resolution; 0 if nothing was recorded
+uint64_t hist_percentile(const struct hist *h, double pct);
+#endif /* hist.h */
@@ -0,0 +1,517 @@
+/*
+ * Micro-benchmarks for the synchronization primitives in fairlock.c
+ * and the waiter queue in mpscq.c
+ *
+ * Usage: lockbench <benchmark> [maxthreads]
+ *
+ * Each benchmark runs with 1, 2, 4, ... maxthreads threads for a fixed
+ * amount of time and prints one line per configuration.
+ * Set FAIRLOCK=ticket to benchmark the futex-based fair lock, or
+ * FAIRLOCK=barge for the barging one.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "fairlock.h"
+#include "mpscq.h"
+
+static const double RUNTIME = 0.5;     // seconds per configuration
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// shared data read inside the critical section, about the size of
+// the dutch piles' top cards
+static volatile uint8_t table[64];
+
+static unsigned
+read_table(void)
+{
+    unsigned sum = 0;
+    for (int i = 0; i < 64; i++)
+        sum += table[i];
+    return sum;
+}
+
+// state shared between the threads of one benchmark run
+struct bench_run {
+    volatile bool stop;
+    pthread_barrier_t start;
+    struct fair_lock *lock;
+    struct fair_rwlock *rwlock;
+    int writepct;               // percentage of rwlock ops that write
+    double maxwait;             // longest wait for the lock, convoy benchmark
+};
+
+struct bench_thread {
+    pthread_t tid;
+    struct bench_run *run;
+    unsigned seed;
+    long ops;
+};
+
+// all readers and writers go through the exclusive fair_lock
+static void *
+fairlock_thread(void *_arg)
+{
+    struct bench_thread *t = _arg;
+    struct bench_run *run = t->run;
+    pthread_barrier_wait(&run->start);
+    while (!run->stop) {
+        fair_lock(run->lock);
+        if (rand_r(&t->seed) % 100 < run->writepct)
+            table[t->ops % 64]++;
+        else
+            read_table();
+        fair_unlock(run->lock);
+        t->ops++;
+    }
+    return NULL;
+}
+
+// readers share the fair_rwlock, writers take it exclusively
+static void *
+rwlock_thread(void *_arg)
+{
+    struct bench_thread *t = _arg;
+    struct bench_run *run = t->run;
+    pthread_barrier_wait(&run->start);
+    while (!run->stop) {
+        if (rand_r(&t->seed) % 100 < run->writepct) {
+            fair_write_lock(run->rwlock);
+            table[t->ops % 64]++;
+            fair_write_unlock(run->rwlock);
+        } else {
+            fair_read_lock(run->rwlock);
+            read_table();
+            fair_read_unlock(run->rwlock);
+        }
+        t->ops++;
+    }
+    return NULL;
+}
+
+// short critical sections with a little work in between, recording
+// the longest time any thread waited for the lock
+static void *
+convoy_thread(void *_arg)
+{
+    struct bench_thread *t = _arg;
+    struct bench_run *run = t->run;
+    double maxwait = 0;
+    pthread_barrier_wait(&run->start);
+    while (!run->stop) {
+        double start = now();
+        fair_lock(run->lock);
+        double waited = now() - start;
+        if (waited > maxwait)
+            maxwait = waited;
+        table[t->ops % 64]++;
+        fair_unlock(run->lock);
+        read_table();
+        t->ops++;
+    }
+    fair_lock(run->lock);
+    if (maxwait > run->maxwait)
+        run->maxwait = maxwait;
+    fair_unlock(run->lock);
+    return NULL;
+}
+
+// run `fn` on `nthreads` threads for RUNTIME seconds, return total ops/s
+static double
+bench_threads(void *(*fn)(void *), struct bench_run *run, int nthreads)
+{
+    struct bench_thread t[nthreads];
+    run->stop = false;
+    pthread_barrier_init(&run->start, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++) {
+        t[i].run = run;
+        t[i].seed = i + 1;
+        t[i].ops = 0;
+        pthread_create(&t[i].tid, NULL, fn, &t[i]);
+    }
+    pthread_barrier_wait(&run->start);
+    double start = now();
+    struct timespec runtime = { 0, RUNTIME * 1e9 };
+    nanosleep(&runtime, NULL);
+    run->stop = true;
+
+    long ops = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(t[i].tid, NULL);
+        ops += t[i].ops;
+    }
+    double elapsed = now() - start;
+    pthread_barrier_destroy(&run->start);
+    return ops / elapsed;
+}
+
+// reader scaling: fair_rwlock vs. fair_lock for read-mostly workloads
+static void
+bench_rwlock(int maxthreads)
+{
+    struct bench_run run;
+    run.lock = fair_lock_new();
+    run.rwlock = fair_rwlock_new();
+
+    const int writepcts[] = { 0, 1, 10 };
+    printf("%-8s %7s %14s %14s %8s\n",
+           "writes%", "threads", "fair_lock/s", "fair_rwlock/s", "speedup");
+    for (int w = 0; w < sizeof writepcts / sizeof writepcts[0]; w++) {
+        run.writepct = writepcts[w];
+        for (int n = 1; n <= maxthreads; n *= 2) {
+            double excl = bench_threads(fairlock_thread, &run, n);
+            double shared = bench_threads(rwlock_thread, &run, n);
+            printf("%-8d %7d %14.0f %14.0f %8.2f\n",
+                   run.writepct, n, excl, shared, shared / excl);
+        }
+    }
+}
+
+// throughput vs. worst-case wait of each kind of fair lock, and of
+// barging locks with different bounds on the wait
+static void
+bench_convoy(int maxthreads)
+{
+    struct {
+        const char *name;
+        enum fair_lock_kind kind;
+        unsigned maxwait_us;
+    } locks[] = {
+        { "queue", FAIR_LOCK_QUEUE },
+        { "ticket", FAIR_LOCK_TICKET },
+        { "barge", FAIR_LOCK_BARGE, 100 },
+        { "barge", FAIR_LOCK_BARGE, 1000 },
+        { "barge", FAIR_LOCK_BARGE, 10000 },
+    };
+    printf("%-8s %9s %7s %12s %12s\n", "kind", "maxwait", "threads", "ops/s", "worst wait");
+    for (int k = 0; k < sizeof locks / sizeof locks[0]; k++) {
+        for (int n = 1; n <= maxthreads * 4; n *= 2) {
+            struct bench_run run = { .maxwait = 0 };
+            run.lock = locks[k].kind == FAIR_LOCK_BARGE
+                     ? fair_lock_new_barge(locks[k].maxwait_us)
+                     : fair_lock_new_kind(locks[k].kind);
+            double ops = bench_threads(convoy_thread, &run, n);
+            if (locks[k].kind == FAIR_LOCK_BARGE)
+                printf("%-8s %7uus", locks[k].name, locks[k].maxwait_us);
+            else
+                printf("%-8s %9s", locks[k].name, "-");
+            printf(" %7d %12.0f %10.0fus\n", n, ops, run.maxwait * 1e6);
+            fair_lock_free(run.lock);
+        }
+    }
+}
+
+// state shared by the threads of the broadcast benchmark
+struct bcast_run {
+    struct fair_lock *lock;
+    struct fair_cond *go;       // broadcast to start a new round
+    struct fair_cond *done;     // signaled when all waiters have run
+    int nwaiters;
+    int round;                  // current round, -1 to exit
+    int arrived;                // waiters that have seen this round
+};
+
+static void *
+bcast_waiter(void *_arg)
+{
+    struct bcast_run *run = _arg;
+    int seen = 0;
+    fair_lock(run->lock);
+    while (run->round != -1) {
+        while (run->round == seen)
+            fair_cond_wait(run->go);
+        if (run->round == -1)
+            break;
+        seen = run->round;
+        if (++run->arrived == run->nwaiters)
+            fair_cond_signal(run->done);
+    }
+    fair_unlock(run->lock);
+    return NULL;
+}
+
+static long
+context_switches(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+// wake-up cost of fair_cond_broadcast with many waiters
+static void
+bench_broadcast(int maxthreads)
+{
+    printf("%8s %12s %16s\n", "waiters", "rounds/s", "ctxsw/waiter");
+    for (int n = 1; n <= maxthreads * 8; n *= 2) {
+        struct bcast_run run = { .nwaiters = n, .round = 0, .arrived = 0 };
+        run.lock = fair_lock_new();
+        run.go = fair_cond_new(run.lock);
+        run.done = fair_cond_new(run.lock);
+
+        pthread_t t[n];
+        for (int i = 0; i < n; i++)
+            pthread_create(&t[i], NULL, bcast_waiter, &run);
+
+        int rounds = 0;
+        long csw = context_switches();
+        double start = now();
+        while (now() - start < RUNTIME) {
+            fair_lock(run.lock);
+            run.arrived = 0;
+            run.round = ++rounds;
+            fair_cond_broadcast(run.go);
+            while (run.arrived < n)
+                fair_cond_wait(run.done);
+            fair_unlock(run.lock);
+        }
+        double elapsed = now() - start;
+        csw = context_switches() - csw;
+
+        fair_lock(run.lock);
+        run.round = -1;
+        fair_cond_broadcast(run.go);
+        fair_unlock(run.lock);
+        for (int i = 0; i < n; i++)
+            pthread_join(t[i], NULL);
+
+        printf("%8d %12.0f %16.2f\n", n, rounds / elapsed, (double) csw / rounds / n);
+    }
+}
+
+// state shared by the threads of the stress test
+struct stress_run {
+    struct fair_lock *lock;
+    struct fair_cond *cond;
+    int iterations;             // per thread
+    int inside;                 // threads inside the critical section
+    long counter;               // incremented non-atomically under the lock
+    bool failed;
+    pthread_barrier_t start;
+};
+
+static void
+stress_enter(struct stress_run *run)
+{
+    if (run->inside++ != 0)
+        run->failed = true;
+}
+
+static void
+stress_leave(struct stress_run *run)
+{
+    if (--run->inside != 0)
+        run->failed = true;
+}
+
+// hammer lock, unlock, signal and timed waits; check mutual exclusion
+static void *
+stress_thread(void *_arg)
+{
+    struct stress_run *run = _arg;
+    unsigned seed = (uintptr_t) &seed;
+    pthread_barrier_wait(&run->start);
+    for (int i = 0; i < run->iterations; i++) {
+        fair_lock(run->lock);
+        stress_enter(run);
+        run->counter++;
+        int r = rand_r(&seed) % 64;
+        if (r == 0) {
+            // get preempted while holding the lock
+            sched_yield();
+        } else if (r == 1) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 100000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            stress_leave(run);
+            fair_cond_timedwait(run->cond, &deadline);
+            stress_enter(run);
+        } else if (r == 2) {
+            fair_cond_signal(run->cond);
+        } else if (r == 3) {
+            fair_cond_broadcast(run->cond);
+        }
+        stress_leave(run);
+        fair_unlock(run->lock);
+    }
+    return NULL;
+}
+
+// correctness under heavy oversubscription, for each kind of fair lock
+static void
+bench_stress(int maxthreads)
+{
+    const char *kinds[] = { "queue", "ticket", "barge" };
+    bool failed = false;
+    printf("%-8s %7s %12s %8s\n", "kind", "threads", "ops/s", "result");
+    for (int k = 0; k < 3; k++) {
+        for (int n = maxthreads; n <= maxthreads * 16; n *= 4) {
+            struct stress_run run = { .iterations = 20000, .inside = 0, .counter = 0 };
+            run.lock = fair_lock_new_kind((enum fair_lock_kind) k);
+            run.cond = fair_cond_new(run.lock);
+            run.failed = false;
+            pthread_barrier_init(&run.start, NULL, n + 1);
+
+            pthread_t t[n];
+            for (int i = 0; i < n; i++)
+                pthread_create(&t[i], NULL, stress_thread, &run);
+            pthread_barrier_wait(&run.start);
+            double start = now();
+            for (int i = 0; i < n; i++)
+                pthread_join(t[i], NULL);
+            double elapsed = now() - start;
+            pthread_barrier_destroy(&run.start);
+
+            bool ok = !run.failed && run.counter == (long) n * run.iterations;
+            failed |= !ok;
+            printf("%-8s %7d %12.0f %8s\n", kinds[k], n, run.counter / elapsed,
+                   ok ? "ok" : "FAILED");
+        }
+    }
+    if (failed)
+        exit(EXIT_FAILURE);
+}
+
+// a queued item of the queue benchmark, in both kinds of queue
+struct queue_node {
+    struct list_elem elem;
+    struct mpsc_elem qelem;
+};
+
+// state shared by the threads of the queue benchmark
+struct queue_run {
+    bool lockfree;              // mpsc_queue, or list + pthread mutex
+    struct mpsc_queue mpsc;
+    struct list list;
+    pthread_mutex_t lock;
+    struct queue_node *nodes;   // `pushes` nodes per producer
+    int pushes;
+    pthread_barrier_t start;
+};
+
+struct queue_producer {
+    pthread_t tid;
+    struct queue_run *run;
+    struct queue_node *nodes;
+};
+
+static void *
+queue_producer(void *_arg)
+{
+    struct queue_producer *p = _arg;
+    struct queue_run *run = p->run;
+    pthread_barrier_wait(&run->start);
+    for (int i = 0; i < run->pushes; i++) {
+        if (run->lockfree) {
+            mpsc_push(&run->mpsc, &p->nodes[i].qelem);
+        } else {
+            pthread_mutex_lock(&run->lock);
+            list_push_back(&run->list, &p->nodes[i].elem);
+            pthread_mutex_unlock(&run->lock);
+        }
+    }
+    return NULL;
+}
+
+// `nproducers` threads push while the calling thread pops everything;
+// returns items/s
+static double
+queue_throughput(struct queue_run *run, int nproducers)
+{
+    struct queue_producer p[nproducers];
+    long total = (long) nproducers * run->pushes;
+    mpsc_init(&run->mpsc);
+    list_init(&run->list);
+    pthread_barrier_init(&run->start, NULL, nproducers + 1);
+    for (int i = 0; i < nproducers; i++) {
+        p[i].run = run;
+        p[i].nodes = run->nodes + (long) i * run->pushes;
+        pthread_create(&p[i].tid, NULL, queue_producer, &p[i]);
+    }
+    pthread_barrier_wait(&run->start);
+    double start = now();
+    for (long popped = 0; popped < total; ) {
+        bool got;
+        if (run->lockfree) {
+            got = mpsc_pop(&run->mpsc) != NULL;
+        } else {
+            pthread_mutex_lock(&run->lock);
+            got = !list_empty(&run->list);
+            if (got)
+                list_pop_front(&run->list);
+            pthread_mutex_unlock(&run->lock);
+        }
+        if (got)
+            popped++;
+        else
+            sched_yield();
+    }
+    double elapsed = now() - start;
+    for (int i = 0; i < nproducers; i++)
+        pthread_join(p[i].tid, NULL);
+    pthread_barrier_destroy(&run->start);
+    return total / elapsed;
+}
+
+// waiter queue: lock-free mpsc_push/mpsc_pop vs. list_push_back and
+// list_pop_front under a pthread mutex, with one consumer
+static void
+bench_mpsc(int maxthreads)
+{
+    struct queue_run run = { .pushes = 200000 };
+    pthread_mutex_init(&run.lock, NULL);
+    run.nodes = malloc(sizeof(struct queue_node) * maxthreads * run.pushes);
+
+    printf("%9s %14s %14s %8s\n", "producers", "mutex+list/s", "mpsc/s", "speedup");
+    for (int n = 1; n <= maxthreads; n *= 2) {
+        run.lockfree = false;
+        double locked = queue_throughput(&run, n);
+        run.lockfree = true;
+        double lockfree = queue_throughput(&run, n);
+        printf("%9d %14.0f %14.0f %8.2f\n", n, locked, lockfree, lockfree / locked);
+    }
+    free(run.nodes);
+}
+
+static struct {
+    const char *name;
+    void (*run)(int maxthreads);
+} benchmarks[] = {
+    { "rwlock", bench_rwlock },
+    { "broadcast", bench_broadcast },
+    { "convoy", bench_convoy },
+    { "stress", bench_stress },
+    { "mpsc", bench_mpsc },
+};
+
+int
+main(int ac, char *av[])
+{
+    int nbench = sizeof benchmarks / sizeof benchmarks[0];
+    int maxthreads = ac > 2 ? atoi(av[2]) : 8;
+    for (int i = 0; i < nbench; i++) {
+        if (ac > 1 && strcmp(av[1], benchmarks[i].name))
+            continue;
+        printf("== %s\n", benchmarks[i].name);
+        benchmarks[i].run(maxthreads);
+    }
+}
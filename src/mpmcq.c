@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "mpmcq.h"
+
+/* Returns a new, empty queue that holds at least CAPACITY items. */
+struct mpmc_queue *
+mpmc_new (unsigned capacity)
+{
+  struct mpmc_queue *q = aligned_alloc (64, sizeof *q);
+  unsigned size = 1;
+  while (size < capacity)
+    size *= 2;
+
+  q->mask = size - 1;
+  q->slots = malloc (sizeof *q->slots * size);
+  for (unsigned i = 0; i < size; i++)
+    q->slots[i].seq = i;
+  q->tail = 0;
+  q->head = 0;
+  return q;
+}
+
+/* Frees Q, which must not be in use. */
+void
+mpmc_free (struct mpmc_queue *q)
+{
+  free (q->slots);
+  free (q);
+}
+
+/* Appends ITEM to Q.  Returns false if Q is full. */
+bool
+mpmc_push (struct mpmc_queue *q, void *item)
+{
+  unsigned pos = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+  for (;;)
+    {
+      struct mpmc_slot *slot = &q->slots[pos & q->mask];
+      unsigned seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+      int diff = (int) (seq - pos);
+      if (diff == 0)
+        {
+          /* The slot is free: claim it by advancing the tail. */
+          if (__atomic_compare_exchange_n (&q->tail, &pos, pos + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+              slot->item = item;
+              __atomic_store_n (&slot->seq, pos + 1, __ATOMIC_RELEASE);
+              return true;
+            }
+        }
+      else if (diff < 0)
+        return false;   /* The slot still holds the item from a lap ago. */
+      else
+        pos = __atomic_load_n (&q->tail, __ATOMIC_RELAXED);
+    }
+}
+
+/* Removes and returns the front item of Q, or NULL if Q is empty. */
+void *
+mpmc_pop (struct mpmc_queue *q)
+{
+  unsigned pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+  for (;;)
+    {
+      struct mpmc_slot *slot = &q->slots[pos & q->mask];
+      unsigned seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+      int diff = (int) (seq - (pos + 1));
+      if (diff == 0)
+        {
+          if (__atomic_compare_exchange_n (&q->head, &pos, pos + 1, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+              void *item = slot->item;
+              /* Hand the slot to the producer one lap ahead. */
+              __atomic_store_n (&slot->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+              return item;
+            }
+        }
+      else if (diff < 0)
+        return NULL;    /* The slot has not been filled yet. */
+      else
+        pos = __atomic_load_n (&q->head, __ATOMIC_RELAXED);
+    }
+}
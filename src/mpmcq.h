@@ -0,0 +1,38 @@
+#ifndef __MPMCQ_H
+#define __MPMCQ_H
+/* Bounded lock-free multi-producer/multi-consumer queue of pointers.
+
+   The queue is a ring of slots, each with a sequence number that tells
+   producers and consumers whose turn it is (Dmitry Vyukov's bounded
+   MPMC queue).  Pushing and popping each take one compare-and-swap on
+   the tail or head counter, and neither ever blocks: mpmc_push() fails
+   if the queue is full, mpmc_pop() returns NULL if it is empty.
+
+   Unlike mpscq.h, items are not intrusive: the queue stores pointers
+   and owns the memory for its slots. */
+
+#include <stdbool.h>
+
+/* Slot of the ring. */
+struct mpmc_slot
+  {
+    unsigned seq;               /* Whose turn it is, accessed atomically. */
+    void *item;
+  };
+
+/* Queue.  Head and tail are on their own cache lines, so that
+   producers and consumers do not invalidate each other's counter. */
+struct mpmc_queue
+  {
+    unsigned mask;              /* Capacity - 1, capacity a power of 2. */
+    struct mpmc_slot *slots;
+    unsigned tail __attribute__((aligned(64)));  /* Next slot to push. */
+    unsigned head __attribute__((aligned(64)));  /* Next slot to pop. */
+  };
+
+struct mpmc_queue *mpmc_new (unsigned capacity);
+void mpmc_free (struct mpmc_queue *);
+bool mpmc_push (struct mpmc_queue *, void *item);
+void *mpmc_pop (struct mpmc_queue *);
+
+#endif /* mpmcq.h */
@@ -0,0 +1,66 @@
+#include "mpscq.h"
+
+/* Initializes Q as an empty queue. */
+void
+mpsc_init (struct mpsc_queue *q)
+{
+  q->stub.next = NULL;
+  q->head = &q->stub;
+  q->tail = &q->stub;
+}
+
+/* Appends E to Q.  May be called by any number of threads at once. */
+void
+mpsc_push (struct mpsc_queue *q, struct mpsc_elem *e)
+{
+  __atomic_store_n (&e->next, NULL, __ATOMIC_RELAXED);
+  struct mpsc_elem *prev = __atomic_exchange_n (&q->head, e, __ATOMIC_ACQ_REL);
+  __atomic_store_n (&prev->next, e, __ATOMIC_RELEASE);
+}
+
+/* Removes and returns the front element of Q, or returns NULL if Q
+   is empty or its front element is still being pushed.
+   Must only be called by the consumer. */
+struct mpsc_elem *
+mpsc_pop (struct mpsc_queue *q)
+{
+  struct mpsc_elem *tail = q->tail;
+  struct mpsc_elem *next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+
+  if (tail == &q->stub)
+    {
+      if (next == NULL)
+        return NULL;
+      q->tail = next;
+      tail = next;
+      next = __atomic_load_n (&next->next, __ATOMIC_ACQUIRE);
+    }
+  if (next != NULL)
+    {
+      q->tail = next;
+      return tail;
+    }
+
+  /* TAIL is the last element, unless a push is in progress. */
+  if (tail != __atomic_load_n (&q->head, __ATOMIC_ACQUIRE))
+    return NULL;
+
+  /* Put the stub back behind TAIL so that TAIL can be removed. */
+  mpsc_push (q, &q->stub);
+  next = __atomic_load_n (&tail->next, __ATOMIC_ACQUIRE);
+  if (next != NULL)
+    {
+      q->tail = next;
+      return tail;
+    }
+  return NULL;
+}
+
+/* Returns true if Q is empty and no push is in progress.
+   Must only be called by the consumer. */
+bool
+mpsc_empty (struct mpsc_queue *q)
+{
+  return q->tail == &q->stub
+         && __atomic_load_n (&q->head, __ATOMIC_ACQUIRE) == &q->stub;
+}
@@ -0,0 +1,55 @@
+#ifndef __MPSCQ_H
+#define __MPSCQ_H
+/* Lock-free multi-producer/single-consumer intrusive queue.
+
+   Like the lists in list.h, this queue does not allocate memory:
+   each structure that can be queued embeds a struct mpsc_elem, and
+   mpsc_entry() converts a queued element back to its structure.
+
+      struct foo
+        {
+          struct mpsc_elem elem;
+          ...other members...
+        };
+
+   Any number of threads may call mpsc_push() concurrently, without
+   locking.  Only one thread at a time may call mpsc_pop() and
+   mpsc_empty(), e.g. the thread that holds a lock protecting the
+   consumer side.
+
+   The algorithm is Dmitry Vyukov's intrusive MPSC queue: a push is a
+   single atomic exchange of the head pointer followed by a store that
+   links the previous element.  Between those two steps the new element
+   is not yet reachable, so mpsc_pop() may return NULL while a push is
+   in progress even though mpsc_empty() is false. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Queue element. */
+struct mpsc_elem
+  {
+    struct mpsc_elem *next;     /* Next element, accessed atomically. */
+  };
+
+/* Queue. */
+struct mpsc_queue
+  {
+    struct mpsc_elem *head;     /* Most recently pushed element. */
+    struct mpsc_elem *tail;     /* Next element to pop (consumer only). */
+    struct mpsc_elem stub;      /* Keeps the queue non-empty internally. */
+  };
+
+/* Converts pointer to queue element MPSC_ELEM into a pointer to
+   the structure that MPSC_ELEM is embedded inside. */
+#define mpsc_entry(MPSC_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(MPSC_ELEM)->next     \
+                     - offsetof (STRUCT, MEMBER.next)))
+
+void mpsc_init (struct mpsc_queue *);
+void mpsc_push (struct mpsc_queue *, struct mpsc_elem *);
+struct mpsc_elem *mpsc_pop (struct mpsc_queue *);
+bool mpsc_empty (struct mpsc_queue *);
+
+#endif /* mpscq.h */
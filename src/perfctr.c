@@ -0,0 +1,144 @@
+/*
+ * Per-thread performance counters, see perfctr.h
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+static const char *names[PERF_COUNTERS] = {
+    "cycles", "instr", "llc-miss", "br-miss", "ctx-sw", "cpu-ms"
+};
+
+// the perf event of each counter, if any
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[PERF_COUNTERS] = {
+    [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_CACHE_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_CONTEXT_SWITCHES] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+// PERF_CPU_NS has no event: it is always read from the thread CPU clock
+static const int NEVENTS = PERF_CPU_NS;
+
+// counters opened by some thread, and counters that failed to open in
+// some thread, as bit masks, accessed atomically
+static unsigned opened, failed;
+
+// the events of a thread, -1 where not open
+struct perf_fds {
+    int fd[PERF_CPU_NS];
+};
+
+static pthread_key_t fdskey;
+static pthread_once_t fdsonce = PTHREAD_ONCE_INIT;
+
+static void
+close_fds(void *_fds)
+{
+    struct perf_fds *fds = _fds;
+    for (int i = 0; i < NEVENTS; i++)
+        if (fds->fd[i] >= 0)
+            close(fds->fd[i]);
+    free(fds);
+}
+
+static void
+create_key(void)
+{
+    pthread_key_create(&fdskey, close_fds);
+}
+
+// the events of the calling thread, opened on first use
+static struct perf_fds *
+thread_fds(void)
+{
+    pthread_once(&fdsonce, create_key);
+    struct perf_fds *fds = pthread_getspecific(fdskey);
+    if (fds)
+        return fds;
+
+    fds = malloc(sizeof *fds);
+    for (int i = 0; i < NEVENTS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof attr);
+        attr.size = sizeof attr;
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        // count hardware events in user space only; context switches
+        // happen in the kernel
+        attr.exclude_kernel = events[i].type == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+        fds->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        __atomic_fetch_or(fds->fd[i] >= 0 ? &opened : &failed, 1u << i, __ATOMIC_RELAXED);
+    }
+    pthread_setspecific(fdskey, fds);
+    return fds;
+}
+
+// short name of a counter
+const char *
+perf_counter_name(enum perf_counter counter)
+{
+    return names[counter];
+}
+
+// read the counters of the calling thread
+void
+perf_read(struct perf_sample *sample)
+{
+    struct perf_fds *fds = thread_fds();
+    for (int i = 0; i < NEVENTS; i++) {
+        sample->value[i] = 0;
+        if (fds->fd[i] >= 0 && read(fds->fd[i], &sample->value[i], sizeof sample->value[i])
+                               != sizeof sample->value[i])
+            sample->value[i] = 0;
+    }
+    if (fds->fd[PERF_CONTEXT_SWITCHES] < 0) {
+        struct rusage ru;
+        getrusage(RUSAGE_THREAD, &ru);
+        sample->value[PERF_CONTEXT_SWITCHES] = ru.ru_nvcsw + ru.ru_nivcsw;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    sample->value[PERF_CPU_NS] = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// true if `counter` comes from perf_event_open() rather than a fallback
+bool
+perf_from_events(enum perf_counter counter)
+{
+    unsigned bit = 1u << counter;
+    return counter < NEVENTS && (__atomic_load_n(&opened, __ATOMIC_RELAXED) & bit)
+           && !(__atomic_load_n(&failed, __ATOMIC_RELAXED) & bit);
+}
+
+// true if `counter` could be read by the threads that read counters so
+// far, counting context switches with getrusage() as available
+bool
+perf_available(enum perf_counter counter)
+{
+    return counter == PERF_CONTEXT_SWITCHES || counter == PERF_CPU_NS
+           || perf_from_events(counter);
+}
+
+// add what was counted between `begin` and `end` to `total`
+void
+perf_add(struct perf_total *total, const struct perf_sample *begin,
+         const struct perf_sample *end)
+{
+    for (int i = 0; i < PERF_COUNTERS; i++)
+        total->value[i] += end->value[i] - begin->value[i];
+    total->intervals++;
+}
@@ -0,0 +1,55 @@
+#ifndef __PERFCTR_H
+#define __PERFCTR_H
+/*
+ * Per-thread performance counters from Linux perf_event_open().
+ *
+ * Each thread that reads its counters gets its own set of events,
+ * opened on first use and closed when the thread exits; they count
+ * only that thread, in user space. Where an event cannot be opened,
+ * e.g. because perf events are restricted by
+ * /proc/sys/kernel/perf_event_paranoid or there is no hardware PMU,
+ * context switches fall back to getrusage(RUSAGE_THREAD) and the other
+ * hardware counters read as unavailable. Thread CPU time is always
+ * measured, from CLOCK_THREAD_CPUTIME_ID.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,          // last-level cache misses
+    PERF_BRANCH_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_CPU_NS,                // thread CPU time
+    PERF_COUNTERS,
+};
+
+// counter values of a thread at some point in time
+struct perf_sample {
+    uint64_t value[PERF_COUNTERS];
+};
+
+// counts added up over several intervals
+struct perf_total {
+    uint64_t value[PERF_COUNTERS];
+    long intervals;
+};
+
+// short name of a counter
+const char *perf_counter_name(enum perf_counter counter);
+
+// read the counters of the calling thread
+void perf_read(struct perf_sample *sample);
+
+// true if `counter` could be read by the threads that read counters so
+// far, counting context switches with getrusage() as available
+bool perf_available(enum perf_counter counter);
+
+// true if `counter` comes from perf_event_open() rather than a fallback
+bool perf_from_events(enum perf_counter counter);
+
+// add what was counted between `begin` and `end` to `total`
+void perf_add(struct perf_total *total, const struct perf_sample *begin,
+              const struct perf_sample *end);
+#endif /* perfctr.h */
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #include "pile.h"
@@ -9,9 +10,9 @@
 
 void pile_init(struct pile *pile, int cap)
 {
+    assert (cap <= PILE_MAXCAP);
     pile->top = 0;
     pile->cap = cap;
-    pile->_cards = malloc(cap * sizeof(uint8_t));
 }
 
 void pile_push(struct pile *pile, uint8_t card)
@@ -20,6 +21,14 @@ void pile_push(struct pile *pile, uint8_t card)
     pile->_cards[pile->top++] = card;
 }
 
+// push n cards at once, cards[n-1] ending up on top
+void pile_push_many(struct pile *pile, const uint8_t *cards, int n)
+{
+    assert (pile->top + n <= pile->cap);
+    memcpy(pile->_cards + pile->top, cards, n);
+    pile->top += n;
+}
+
 uint8_t pile_pop(struct pile *pile)
 {
     assert (pile->top > 0);
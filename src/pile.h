@@ -1,15 +1,27 @@
+#ifndef __PILE_H
+#define __PILE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
 
+// largest pile in the game: the wood piles hold up to 30 cards
+#define PILE_MAXCAP 30
+
+// cards are stored inline so that piles, and any state built from
+// them, can be copied with memcpy()
 struct pile {
-    int top; 
-    int cap;
-    uint8_t *_cards;
+    uint8_t top; 
+    uint8_t cap;
+    uint8_t _cards[PILE_MAXCAP];
 };
 
 void pile_init(struct pile *pile, int cap);
 void pile_push(struct pile *pile, uint8_t card);
+void pile_push_many(struct pile *pile, const uint8_t *cards, int n);
 uint8_t pile_pop(struct pile *pile);
 void pile_rotate_top_card_down(struct pile *pile);
 uint8_t pile_top(struct pile *pile);
 bool pile_empty(struct pile *pile);
 int pile_size(struct pile *pile);
 void pile_dump(struct pile *pile, FILE *out);
+#endif /* pile.h */
@@ -0,0 +1,157 @@
+/*
+ * Append-only columnar results file, see results.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "results.h"
+
+// open `path` for appending, creating it if needed; NULL on error
+struct results_file *
+results_open(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size % sizeof(struct results_block) != 0) {
+        fprintf(stderr, "%s: not a results file\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    struct results_file *rf = malloc(sizeof *rf);
+    if (rf == NULL) {
+        perror("malloc");
+        close(fd);
+        return NULL;
+    }
+    rf->fd = fd;
+    rf->offset = st.st_size;
+    if (st.st_size == 0) {
+        rf->block.magic = RESULTS_MAGIC;
+        rf->block.rows = 0;
+        return rf;
+    }
+
+    // continue filling the last block if it has room
+    struct results_block *b = &rf->block;
+    off_t last = st.st_size - sizeof *b;
+    if (pread(fd, b, sizeof *b, last) != sizeof *b
+        || b->magic != RESULTS_MAGIC || b->rows > RESULTS_BLOCK) {
+        fprintf(stderr, "%s: not a results file\n", path);
+        close(fd);
+        free(rf);
+        return NULL;
+    }
+    if (b->rows < RESULTS_BLOCK)
+        rf->offset = last;
+    else
+        b->rows = 0;
+    return rf;
+}
+
+// append the result of the game dealt from `seed`
+void
+results_append(struct results_file *rf, uint64_t seed, const struct game_result *result)
+{
+    struct results_block *b = &rf->block;
+    uint32_t i = b->rows++;
+    b->seed[i] = seed;
+    b->moves[i] = result->moves;
+    for (int j = 0; j < 4; j++)
+        b->scores[j][i] = result->scores[j];
+    b->winner[i] = result->winner;
+    b->end[i] = result->end;
+
+    if (b->rows == RESULTS_BLOCK) {
+        results_flush(rf);
+        rf->offset += sizeof *b;
+        b->rows = 0;
+    }
+}
+
+// write out the games appended so far; returns false on I/O error.
+// A partly filled block is rewritten in place on every flush.
+bool
+results_flush(struct results_file *rf)
+{
+    if (rf->block.rows == 0)
+        return true;
+    if (pwrite(rf->fd, &rf->block, sizeof rf->block, rf->offset) != sizeof rf->block) {
+        perror("results");
+        return false;
+    }
+    return true;
+}
+
+// flush and close; returns false on I/O error
+bool
+results_close(struct results_file *rf)
+{
+    bool ok = results_flush(rf);
+    if (close(rf->fd) < 0) {
+        perror("results");
+        ok = false;
+    }
+    free(rf);
+    return ok;
+}
+
+// map `path` read-only; returns false if it is not a results file
+bool
+results_map(const char *path, struct results_map *map)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size % sizeof(struct results_block) != 0) {
+        fprintf(stderr, "%s: not a results file\n", path);
+        close(fd);
+        return false;
+    }
+    map->size = st.st_size;
+    map->nblocks = st.st_size / sizeof(struct results_block);
+    map->blocks = NULL;
+    if (map->size > 0) {
+        void *p = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return false;
+        }
+        map->blocks = p;
+    }
+    close(fd);
+
+    for (size_t i = 0; i < map->nblocks; i++)
+        if (map->blocks[i].magic != RESULTS_MAGIC || map->blocks[i].rows > RESULTS_BLOCK) {
+            fprintf(stderr, "%s: block %zu is damaged\n", path, i);
+            results_unmap(map);
+            return false;
+        }
+    return true;
+}
+
+// unmap a file mapped by results_map()
+void
+results_unmap(struct results_map *map)
+{
+    if (map->blocks)
+        munmap((void *) map->blocks, map->size);
+    map->blocks = NULL;
+}
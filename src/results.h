@@ -0,0 +1,77 @@
+#ifndef __RESULTS_H
+#define __RESULTS_H
+/*
+ * Per-game results, kept in an append-only columnar file so that large
+ * batches can be analyzed without playing them again or parsing text.
+ * Set with RESULTS=path; see resultstat.c for a reader.
+ *
+ * The file is a sequence of fixed-size blocks of RESULTS_BLOCK games
+ * each, every column stored contiguously within its block. Blocks are
+ * written in host byte order and layout, so a reader can mmap the file
+ * and use the blocks in place. Only the last block may be partly
+ * filled; appending to the file fills it up first.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// how a game ended
+enum game_end {
+    GAME_BLITZED,       // a player emptied their blitz pile
+    GAME_STUCK,         // all players were stuck
+    GAME_FAILED,        // the game could not be played to the end (MODE=fork)
+};
+
+// outcome of one game
+struct game_result {
+    int scores[4];
+    int winner;         // seat of the player who blitzed, -1 if nobody did
+    int moves;          // moves committed
+    enum game_end end;
+};
+
+#define RESULTS_BLOCK 4096
+#define RESULTS_MAGIC 0x31524244        // "DBR1"
+
+struct results_block {
+    uint32_t magic;                     // RESULTS_MAGIC
+    uint32_t rows;                      // games in this block
+    uint64_t seed[RESULTS_BLOCK];       // deal
+    int32_t moves[RESULTS_BLOCK];       // moves committed
+    int16_t scores[4][RESULTS_BLOCK];   // score of each seat
+    int8_t winner[RESULTS_BLOCK];       // seat who blitzed, -1 if nobody did
+    uint8_t end[RESULTS_BLOCK];         // enum game_end
+};
+
+// a results file open for appending
+struct results_file {
+    int fd;
+    uint64_t offset;                    // where `block` goes in the file
+    struct results_block block;         // being filled
+};
+
+// open `path` for appending, creating it if needed; NULL on error
+struct results_file *results_open(const char *path);
+
+// append the result of the game dealt from `seed`
+void results_append(struct results_file *rf, uint64_t seed, const struct game_result *result);
+
+// write out the games appended so far; returns false on I/O error
+bool results_flush(struct results_file *rf);
+
+// flush and close; returns false on I/O error
+bool results_close(struct results_file *rf);
+
+// a results file mapped for reading
+struct results_map {
+    const struct results_block *blocks;
+    size_t nblocks;
+    size_t size;                        // bytes mapped
+};
+
+// map `path` read-only; returns false if it is not a results file
+bool results_map(const char *path, struct results_map *map);
+
+// unmap a file mapped by results_map()
+void results_unmap(struct results_map *map);
+#endif /* results.h */
@@ -0,0 +1,89 @@
+/*
+ * Summarize per-game results files written with RESULTS=path
+ *
+ * Usage: resultstat <file>...
+ *
+ * The files are mapped and aggregated in place, one column at a time,
+ * so even files of many millions of games are summarized in about the
+ * time it takes to read them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "results.h"
+#include "cards.h"
+
+struct summary {
+    uint64_t games;
+    uint64_t ends[3];           // by enum game_end
+    uint64_t wins[4];
+    int64_t scores[4];
+    int64_t moves;
+    int32_t maxmoves;
+    uint64_t minseed, maxseed;
+};
+
+static void
+summarize_block(struct summary *s, const struct results_block *b)
+{
+    int n = b->rows;
+    for (int i = 0; i < n; i++) {
+        if (s->games + i == 0 || b->seed[i] < s->minseed)
+            s->minseed = b->seed[i];
+        if (b->seed[i] > s->maxseed)
+            s->maxseed = b->seed[i];
+    }
+    for (int i = 0; i < n; i++)
+        s->ends[b->end[i] < 3 ? b->end[i] : GAME_FAILED]++;
+    for (int i = 0; i < n; i++)
+        if (b->winner[i] >= 0 && b->winner[i] < 4)
+            s->wins[b->winner[i]]++;
+    for (int j = 0; j < 4; j++) {
+        int64_t sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += b->scores[j][i];
+        s->scores[j] += sum;
+    }
+    for (int i = 0; i < n; i++) {
+        s->moves += b->moves[i];
+        if (b->moves[i] > s->maxmoves)
+            s->maxmoves = b->moves[i];
+    }
+    s->games += n;
+}
+
+int
+main(int ac, char *av[])
+{
+    if (ac < 2) {
+        fprintf(stderr, "usage: %s <results file>...\n", av[0]);
+        return 1;
+    }
+
+    struct summary s = { 0 };
+    for (int f = 1; f < ac; f++) {
+        struct results_map map;
+        if (!results_map(av[f], &map))
+            return 1;
+        for (size_t i = 0; i < map.nblocks; i++)
+            summarize_block(&s, &map.blocks[i]);
+        results_unmap(&map);
+    }
+
+    printf("%llu games", (unsigned long long) s.games);
+    if (s.games == 0) {
+        printf("\n");
+        return 0;
+    }
+    printf(", seeds %llu-%llu\n", (unsigned long long) s.minseed, (unsigned long long) s.maxseed);
+    printf("%llu blitzed, %llu stuck, %llu failed\n", (unsigned long long) s.ends[GAME_BLITZED],
+           (unsigned long long) s.ends[GAME_STUCK], (unsigned long long) s.ends[GAME_FAILED]);
+    printf("moves per game: mean %.1f, max %d\n", (double) s.moves / s.games, s.maxmoves);
+    printf("%-6s %10s %7s %10s\n", "seat", "wins", "wins%", "score");
+    for (int j = 0; j < 4; j++)
+        printf("%-6s %10llu %6.2f%% %10.3f\n", colors[j], (unsigned long long) s.wins[j],
+               100.0 * s.wins[j] / s.games, (double) s.scores[j] / s.games);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef __RNG_H
+#define __RNG_H
+/*
+ * A small pseudo-random number generator (xorshift64*), so that each
+ * game can be dealt from its own seed and replayed from it.
+ */
+#include <stdint.h>
+
+struct rng {
+    uint64_t state;
+};
+
+// scramble a seed (splitmix64), also used to derive per-game seeds
+static inline uint64_t
+rng_mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline void
+rng_seed(struct rng *rng, uint64_t seed)
+{
+    rng->state = rng_mix(seed) | 1;     // state must not be 0
+}
+
+static inline uint64_t
+rng_next(struct rng *rng)
+{
+    uint64_t x = rng->state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    rng->state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+// uniformly distributed number in [0, n)
+static inline uint32_t
+rng_below(struct rng *rng, uint32_t n)
+{
+    return ((rng_next(rng) >> 32) * n) >> 32;
+}
+#endif /* rng.h */
@@ -0,0 +1,252 @@
+/*
+ * An offline solver for a fixed deal.
+ *
+ * Once the cards are dealt, the outcome of a game depends only on the
+ * order in which the players' moves reach the dutch piles. The solver
+ * explores every interleaving of player_try_to_make_one_move() from the
+ * dealt position: at each state, each player that can move yields one
+ * successor state. A state in which no player can move ends the game,
+ * as does a blitz.
+ *
+ * For every state it computes, per seat, the best and worst score over
+ * all interleavings and the expected score if the next player to move
+ * is chosen uniformly among those that can. Interleavings that commute
+ * reach the same state, so states are Zobrist-hashed into a fixed-size
+ * transposition table. Once a deal has expanded SOLVER_NODES states,
+ * the remaining states are estimated with a single sequential playout
+ * and the deal's result is reported as inexact.
+ *
+ * Environment: SOLVER_TT_MB (table size, default 64),
+ *              SOLVER_NODES (states per deal, default 1000000).
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "game.h"
+#include "rng.h"
+#include "cards.h"
+#include "solver.h"
+
+// positions a card can occupy: per player 2 wood piles of 30,
+// 3 post piles and the blitz pile of 10; plus 16 dutch piles of 10
+#define PLAYER_SLOTS (2 * 30 + 4 * 10)
+#define ZOBRIST_SLOTS (4 * PLAYER_SLOTS + 16 * 10)
+
+// one random key per (position, card)
+static uint64_t zobrist[ZOBRIST_SLOTS][160];
+
+// outcome of a state, per seat
+struct outcome {
+    int8_t best[4];
+    int8_t worst[4];
+    float expected[4];
+};
+
+struct tt_entry {
+    uint64_t key;               // 0 if empty
+    struct outcome outcome;
+};
+
+struct solver {
+    struct tt_entry *table;
+    uint64_t mask;              // table size - 1
+    long budget;                // states to expand per deal
+    long nodes;                 // states expanded for this deal
+    long hits;                  // transposition table hits for this deal
+    bool exact;                 // false if the budget ran out
+};
+
+// dense index 0..159 of a card
+static int
+card_index(uint8_t card)
+{
+    return get_back_color(card) * 40 + get_front_color(card) * 10 + get_card_number(card);
+}
+
+static void
+zobrist_init(void)
+{
+    struct rng rng;
+    rng_seed(&rng, 0x5eed);
+    for (int i = 0; i < ZOBRIST_SLOTS; i++)
+        for (int j = 0; j < 160; j++)
+            zobrist[i][j] = rng_next(&rng);
+}
+
+static uint64_t
+hash_pile(struct pile *pile, int slot, uint64_t h)
+{
+    for (int i = 0; i < pile->top; i++)
+        h ^= zobrist[slot + i][card_index(pile->_cards[i])];
+    return h;
+}
+
+static uint64_t
+hash_state(struct game_state *gs)
+{
+    uint64_t h = 0;
+    for (int p = 0; p < 4; p++) {
+        struct player_state *player = &gs->players[p];
+        int slot = p * PLAYER_SLOTS;
+        h = hash_pile(&player->woodpiledraw, slot, h);
+        h = hash_pile(&player->woodpilediscard, slot + 30, h);
+        for (int i = 0; i < 3; i++)
+            h = hash_pile(&player->post[i], slot + 60 + 10 * i, h);
+        h = hash_pile(&player->blitz, slot + 90, h);
+    }
+    for (int i = 0; i < gs->nextdutch; i++)
+        h = hash_pile(&gs->dutch[i], 4 * PLAYER_SLOTS + 10 * i, h);
+    return h ? h : 1;
+}
+
+// the outcome of a finished game: everybody gets their score
+static void
+final_outcome(struct game_state *gs, struct outcome *o)
+{
+    int scores[4];
+    score_all_players(gs, scores, NULL);
+    for (int i = 0; i < 4; i++) {
+        o->best[i] = o->worst[i] = scores[i];
+        o->expected[i] = scores[i];
+    }
+}
+
+// estimate the outcome of a state by playing it out once
+static void
+estimate_outcome(const struct game_state *gs, struct outcome *o)
+{
+    struct game g;
+    game_reset(&g);
+    game_state_copy(&g.state, gs);
+    game_play_sequential(&g, NULL);
+    final_outcome(&g.state, o);
+}
+
+static void
+solve(struct solver *sv, const struct game_state *gs, struct outcome *o)
+{
+    struct game g;
+    game_state_copy(&g.state, gs);
+    uint64_t key = hash_state(&g.state);
+    struct tt_entry *e = &sv->table[key & sv->mask];
+    if (e->key == key) {
+        sv->hits++;
+        *o = e->outcome;
+        return;
+    }
+
+    if (sv->nodes >= sv->budget) {
+        sv->exact = false;
+        estimate_outcome(gs, o);
+    } else {
+        sv->nodes++;
+        int nmoves = 0;
+        for (int i = 0; i < 4; i++) {
+            o->best[i] = INT8_MIN;
+            o->worst[i] = INT8_MAX;
+            o->expected[i] = 0;
+        }
+        for (int seat = 0; seat < 4; seat++) {
+            game_reset(&g);
+            game_state_copy(&g.state, gs);
+            if (!player_try_to_make_one_move(&g, &g.state.players[seat], NULL))
+                continue;
+
+            struct outcome next;
+            if (g.blitzed)
+                final_outcome(&g.state, &next);
+            else
+                solve(sv, &g.state, &next);
+
+            for (int i = 0; i < 4; i++) {
+                if (next.best[i] > o->best[i])
+                    o->best[i] = next.best[i];
+                if (next.worst[i] < o->worst[i])
+                    o->worst[i] = next.worst[i];
+                o->expected[i] += next.expected[i];
+            }
+            nmoves++;
+        }
+        if (nmoves == 0) {
+            // nobody can move: the game ends in a deadlock
+            game_state_copy(&g.state, gs);
+            final_outcome(&g.state, o);
+        } else {
+            for (int i = 0; i < 4; i++)
+                o->expected[i] /= nmoves;
+        }
+    }
+
+    e->key = key;
+    e->outcome = *o;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// explore all interleavings of the players' moves for `ndeals` deals
+void
+solver_run(int ndeals, uint64_t seed, FILE *out)
+{
+    char *ttmb = getenv("SOLVER_TT_MB");
+    char *nodes = getenv("SOLVER_NODES");
+    size_t tablebytes = (ttmb ? atol(ttmb) : 64) << 20;
+
+    struct solver sv;
+    sv.budget = nodes ? atol(nodes) : 1000000;
+    sv.mask = 1;
+    while ((sv.mask + 1) * sizeof(struct tt_entry) <= tablebytes)
+        sv.mask = 2 * sv.mask + 1;
+    sv.mask >>= 1;
+    sv.table = calloc(sv.mask + 1, sizeof(struct tt_entry));
+    if (sv.table == NULL) {
+        perror("solver table");
+        return;
+    }
+    zobrist_init();
+
+    long totalnodes = 0, totalhits = 0;
+    int nexact = 0;
+    double sum_expected[4] = { 0 };
+    double start = now();
+    for (int d = 0; d < ndeals; d++) {
+        struct game_state gs;
+        struct outcome o;
+        game_deal(&gs, seed + d);
+        sv.nodes = sv.hits = 0;
+        sv.exact = true;
+        solve(&sv, &gs, &o);
+
+        fprintf(out, "deal %llu %s nodes %ld hits %ld\n",
+                (unsigned long long) (seed + d), sv.exact ? "exact" : "inexact",
+                sv.nodes, sv.hits);
+        for (int i = 0; i < 4; i++) {
+            fprintf(out, "  %s best %3d worst %3d expected %6.2f\n",
+                    colors[i], o.best[i], o.worst[i], o.expected[i]);
+            sum_expected[i] += o.expected[i];
+        }
+        totalnodes += sv.nodes;
+        totalhits += sv.hits;
+        nexact += sv.exact;
+    }
+    double elapsed = now() - start;
+
+    fprintf(out, "%d deals, %d exact, %ld nodes, %.0f nodes/s, %.1f%% table hits, %zu MB table\n",
+            ndeals, nexact, totalnodes, totalnodes / elapsed,
+            100.0 * totalhits / (totalhits + totalnodes + (totalhits + totalnodes == 0)),
+            ((sv.mask + 1) * sizeof(struct tt_entry)) >> 20);
+    fprintf(out, "mean expected score:");
+    for (int i = 0; i < 4; i++)
+        fprintf(out, " %.2f", sum_expected[i] / (ndeals ? ndeals : 1));
+    fprintf(out, "\n");
+    free(sv.table);
+}
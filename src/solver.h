@@ -0,0 +1,10 @@
+#ifndef __SOLVER_H
+#define __SOLVER_H
+#include <stdio.h>
+#include <stdint.h>
+
+// explore all interleavings of the players' moves for `ndeals` deals,
+// dealt from seed, seed + 1, ..., and report best, worst and expected
+// score per seat for each deal to `out`
+void solver_run(int ndeals, uint64_t seed, FILE *out);
+#endif /* solver.h */
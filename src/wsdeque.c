@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include "wsdeque.h"
+
+/* Returns a new, empty deque that holds at least CAPACITY tasks. */
+struct ws_deque *
+ws_new (long capacity)
+{
+  struct ws_deque *q = aligned_alloc (64, sizeof *q);
+  long size = 1;
+  while (size < capacity)
+    size *= 2;
+
+  q->top = 0;
+  q->bottom = 0;
+  q->mask = size - 1;
+  q->tasks = malloc (sizeof *q->tasks * size);
+  return q;
+}
+
+/* Frees Q, which must not be in use. */
+void
+ws_free (struct ws_deque *q)
+{
+  free (q->tasks);
+  free (q);
+}
+
+/* Pushes TASK at the bottom of Q.  Owner only.
+   Returns false if Q is full. */
+bool
+ws_push (struct ws_deque *q, long task)
+{
+  long b = __atomic_load_n (&q->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n (&q->top, __ATOMIC_ACQUIRE);
+  if (b - t > q->mask)
+    return false;
+  __atomic_store_n (&q->tasks[b & q->mask], task, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  __atomic_store_n (&q->bottom, b + 1, __ATOMIC_RELAXED);
+  return true;
+}
+
+/* Takes the newest task from the bottom of Q into *TASK.  Owner only.
+   Returns false if Q is empty. */
+bool
+ws_take (struct ws_deque *q, long *task)
+{
+  long b = __atomic_load_n (&q->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n (&q->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  long t = __atomic_load_n (&q->top, __ATOMIC_RELAXED);
+
+  if (t > b)
+    {
+      /* Empty. */
+      __atomic_store_n (&q->bottom, b + 1, __ATOMIC_RELAXED);
+      return false;
+    }
+  *task = __atomic_load_n (&q->tasks[b & q->mask], __ATOMIC_RELAXED);
+  if (t < b)
+    return true;
+
+  /* Last task: race the thieves for it. */
+  bool won = __atomic_compare_exchange_n (&q->top, &t, t + 1, false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+  __atomic_store_n (&q->bottom, b + 1, __ATOMIC_RELAXED);
+  return won;
+}
+
+/* Steals the oldest task from the top of Q into *TASK.
+   May be called by any thread. */
+enum ws_steal_result
+ws_steal (struct ws_deque *q, long *task)
+{
+  long t = __atomic_load_n (&q->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n (&q->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b)
+    return WS_EMPTY;
+
+  *task = __atomic_load_n (&q->tasks[t & q->mask], __ATOMIC_RELAXED);
+  if (!__atomic_compare_exchange_n (&q->top, &t, t + 1, false,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return WS_ABORT;
+  return WS_STOLEN;
+}
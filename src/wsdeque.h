@@ -0,0 +1,40 @@
+#ifndef __WSDEQUE_H
+#define __WSDEQUE_H
+/* Bounded work-stealing deque (Chase and Lev, with the memory orders
+   of Le et al., "Correct and Efficient Work-Stealing for Weak Memory
+   Models", PPoPP 2013).
+
+   The deque belongs to one owner thread, which pushes and takes tasks
+   at the bottom like a stack.  Any other thread may steal tasks from
+   the top, i.e. the oldest ones.  The owner only synchronizes with
+   thieves when the deque is about to run empty.
+
+   Tasks are plain longs, e.g. indices into a table of work.  The
+   capacity is fixed: ws_push() fails when the deque is full. */
+
+#include <stdbool.h>
+
+/* Deque. */
+struct ws_deque
+  {
+    long top __attribute__((aligned(64)));      /* Next task to steal. */
+    long bottom __attribute__((aligned(64)));   /* Next free slot. */
+    long mask;                  /* Capacity - 1, capacity a power of 2. */
+    long *tasks;                /* Accessed atomically. */
+  };
+
+/* Result of ws_steal(). */
+enum ws_steal_result
+  {
+    WS_STOLEN,                  /* Got a task. */
+    WS_EMPTY,                   /* There was nothing to steal. */
+    WS_ABORT,                   /* Lost a race, try again. */
+  };
+
+struct ws_deque *ws_new (long capacity);
+void ws_free (struct ws_deque *);
+bool ws_push (struct ws_deque *, long task);
+bool ws_take (struct ws_deque *, long *task);
+enum ws_steal_result ws_steal (struct ws_deque *, long *task);
+
+#endif /* wsdeque.h */